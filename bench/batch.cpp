@@ -0,0 +1,170 @@
+#include "../core/batch.hpp"
+#include "../core/pool.hpp"
+#include "patches.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Reports render_batch() throughput from one thread up to one per core, over
+// the patch files given on the command line or else the bench modules. With
+// -o, then renders them once more on every core and writes the audio and the
+// notes of each patch in dir.
+//
+// usage: bench_batch [-o dir] [ticks] [patch files...]
+
+struct CorpusPatch {
+  std::string name;
+  std::string data;
+};
+
+// 16 bit stereo, the sizes in the header are filled in by close()
+struct WavFile {
+  std::ofstream out;
+  uint32_t bytes = 0;
+
+  explicit WavFile(const std::string &path)
+      : out(path, std::ios::binary) {
+    out.write("RIFF\0\0\0\0WAVEfmt ", 16);
+    put(16, 4);
+    put(1, 2); // PCM
+    put(2, 2);
+    put(Machine::AUDIO_SAMPLE_RATE, 4);
+    put(Machine::AUDIO_SAMPLE_RATE * 4, 4);
+    put(4, 2);
+    put(16, 2);
+    out.write("data\0\0\0\0", 8);
+  }
+
+  void put(uint32_t v, int size) {
+    for (int i = 0; i < size; ++i)
+      out.put((char)(v >> 8 * i));
+  }
+
+  void write(const int16_t *samples, size_t frames) {
+    for (size_t i = 0; i < 2 * frames; ++i)
+      put((uint16_t)samples[i], 2);
+    bytes += 4 * frames;
+  }
+
+  void close() {
+    out.seekp(4);
+    put(36 + bytes, 4);
+    out.seekp(40);
+    put(bytes, 4);
+    out.close();
+  }
+};
+
+static std::vector<BatchJob> make_jobs(const std::vector<CorpusPatch> &corpus,
+                                       size_t count, unsigned ticks) {
+  std::vector<BatchJob> jobs(count);
+  for (size_t i = 0; i < count; ++i) {
+    jobs[i].patch = corpus[i % corpus.size()].data;
+    jobs[i].ticks = ticks;
+    jobs[i].on_audio = [](const int16_t *, size_t) {};
+  }
+  return jobs;
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_dir = nullptr;
+  int arg = 1;
+  if (arg + 1 < argc && !strcmp(argv[arg], "-o")) {
+    out_dir = argv[arg + 1];
+    arg += 2;
+  }
+
+  unsigned ticks = arg < argc ? atoi(argv[arg++]) : 200;
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<CorpusPatch> corpus;
+  for (; arg < argc; ++arg) {
+    std::ifstream file(argv[arg]);
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", argv[arg]);
+      return 1;
+    }
+
+    std::stringstream data;
+    data << file.rdbuf();
+
+    std::string name = argv[arg];
+    auto slash = name.find_last_of('/');
+    if (slash != std::string::npos)
+      name = name.substr(slash + 1);
+    corpus.push_back({name, data.str()});
+  }
+
+  if (corpus.empty())
+    for (auto &bench : BENCH_PATCHES)
+      corpus.push_back({bench.name, tile_patch(bench.module, 64, 64)});
+
+  // enough jobs for every thread to take several
+  size_t count = std::max(corpus.size(), (size_t)cores * 4);
+
+  printf("%zu patches, %u ticks each\n", count, ticks);
+  printf("  %-8s %14s %14s %8s\n", "threads", "ticks/s", "samples/s",
+         "speedup");
+
+  // powers of two, then every core
+  std::vector<int> steps;
+  for (int threads = 1; threads < cores; threads *= 2)
+    steps.push_back(threads);
+  steps.push_back(cores);
+
+  double single = 0;
+  for (auto threads : steps) {
+    ThreadPool pool(threads);
+    auto jobs = make_jobs(corpus, count, ticks);
+    auto stats = render_batch(pool, jobs);
+
+    if (threads == 1)
+      single = stats.seconds;
+
+    printf("  %-8d %14.1f %14.1f %8.2f\n", threads,
+           stats.ticks / stats.seconds, stats.frames / stats.seconds,
+           single / stats.seconds);
+  }
+
+  if (!out_dir)
+    return 0;
+
+  ThreadPool pool(cores);
+  std::vector<std::unique_ptr<WavFile>> wavs;
+  std::vector<std::unique_ptr<std::ofstream>> notes;
+  std::vector<BatchJob> jobs(corpus.size());
+
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    auto path = std::string(out_dir) + "/" + corpus[i].name;
+    wavs.emplace_back(new WavFile(path + ".wav"));
+    notes.emplace_back(new std::ofstream(path + ".notes"));
+
+    auto &wav = *wavs.back();
+    auto &note_file = *notes.back();
+    jobs[i].patch = corpus[i].data;
+    jobs[i].ticks = ticks;
+    jobs[i].on_audio = [&wav](const int16_t *samples, size_t frames) {
+      wav.write(samples, frames);
+    };
+    jobs[i].on_note = [&note_file](unsigned tick,
+                                   const ChangeSet::NoteEvent &event) {
+      note_file << tick << (event.on ? " on " : " off ") << event.note.channel
+                << " " << event.note.key << " " << event.note.velocity << "\n";
+    };
+  }
+
+  render_batch(pool, jobs);
+
+  for (auto &wav : wavs)
+    wav->close();
+
+  printf("wrote %zu patches to %s\n", corpus.size(), out_dir);
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "../core/machine.hpp"
+#include "patches.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Reports Machine::tick_n throughput over a corpus of patches, with and
+// without fast-forwarding the periodic ones. The corpus is the patch files
+// given on the command line, or else the bench modules, on their own and
+// tiled over a 256x256 grid.
+//
+// usage: bench_corpus [ticks] [patch files...]
+
+struct CorpusPatch {
+  std::string name;
+  std::string data;
+};
+
+struct Run {
+  double seconds;
+  size_t notes;
+};
+
+static Run run(const std::string &patch, unsigned ticks, bool find_cycles) {
+  Machine m;
+  m.load_string(patch);
+  m.find_cycles = find_cycles;
+
+  size_t notes = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  m.tick_n(ticks, [&](unsigned, const ChangeSet::NoteEvent &event) {
+    notes += event.on;
+  });
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return {elapsed.count(), notes};
+}
+
+int main(int argc, char *argv[]) {
+  unsigned ticks = argc > 1 ? atoi(argv[1]) : 10000;
+
+  std::vector<CorpusPatch> corpus;
+  for (int i = 2; i < argc; ++i) {
+    std::ifstream file(argv[i]);
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", argv[i]);
+      return 1;
+    }
+
+    std::stringstream data;
+    data << file.rdbuf();
+    corpus.push_back({argv[i], data.str()});
+  }
+
+  if (corpus.empty()) {
+    for (auto &bench : BENCH_PATCHES) {
+      int rows = 0;
+      while (bench.module[rows])
+        rows++;
+
+      corpus.push_back({bench.name, tile_patch(bench.module,
+                                               strlen(bench.module[0]), rows)});
+      corpus.push_back({std::string(bench.name) + "-256",
+                        tile_patch(bench.module, 256, 256)});
+    }
+  }
+
+  printf("%u ticks per patch\n", ticks);
+  printf("  %-24s %14s %14s %8s\n", "patch", "ticks/s", "with cycles",
+         "notes");
+
+  double total = 0, total_cycles = 0;
+  for (auto &patch : corpus) {
+    auto ticked = run(patch.data, ticks, false);
+    auto skipped = run(patch.data, ticks, true);
+    total += ticked.seconds;
+    total_cycles += skipped.seconds;
+
+    printf("  %-24s %14.1f %14.1f %8zu\n", patch.name.c_str(),
+           ticks / ticked.seconds, ticks / skipped.seconds, ticked.notes);
+  }
+
+  printf("  %-24s %14.1f %14.1f\n", "all",
+         corpus.size() * ticks / total, corpus.size() * ticks / total_cycles);
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <string>
+
+// Small self-contained modules, tile_patch() repeats them to build grids of
+// any size. "engine" only exercises the operators, "notes" adds both note
+// operators so the synth and the note bookkeeping show up as well.
+static const char *const ENGINE_MODULE[] = {
+    "................",
+    ".#.bench.#......",
+    "...wC4..........",
+    ".gD204TCAFE.....",
+    "...J..C.g.......",
+    "...8C4..........",
+    ".4D234TCAFE.....",
+    "...Y.3E.4.......",
+    ".2I6..1AC..3M4..",
+    "...........aV...",
+    nullptr,
+};
+
+static const char *const NOTES_MODULE[] = {
+    "................",
+    ".#.bench.#......",
+    "...wC4..........",
+    ".gD204TCAFE.....",
+    "...:02C.g.......",
+    "...8C4..........",
+    ".4D234TCAFE.....",
+    "...%13E.4.......",
+    ".2I6..1AC..3M4..",
+    "...........aV...",
+    nullptr,
+};
+
+// ENGINE_MODULE in one corner of a mostly empty 64x32 area, about as sparse
+// as hand-written patches usually are.
+static const char *const SPARSE_MODULE[] = {
+    "................................................................",
+    ".#.bench.#......................................................",
+    "...wC4..........................................................",
+    ".gD204TCAFE.....................................................",
+    "...J..C.g.......................................................",
+    "...8C4..........................................................",
+    ".4D234TCAFE.....................................................",
+    "...Y.3E.4.......................................................",
+    ".2I6..1AC..3M4..................................................",
+    "...........aV...................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    "................................................................",
+    nullptr,
+};
+
+struct BenchPatch {
+  const char *name;
+  const char *const *module;
+};
+
+static const BenchPatch BENCH_PATCHES[] = {
+    {"engine", ENGINE_MODULE},
+    {"notes", NOTES_MODULE},
+    {"sparse", SPARSE_MODULE},
+};
+
+static inline std::string tile_patch(const char *const *module, int width,
+                                     int height) {
+  int rows = 0;
+  while (module[rows])
+    rows++;
+
+  std::string out;
+  for (int y = 0; y < height; ++y) {
+    const std::string row = module[y % rows];
+
+    for (int x = 0; x < width; ++x)
+      out.push_back(row[x % row.size()]);
+    out.push_back('\n');
+  }
+
+  return out;
+}
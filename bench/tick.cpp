@@ -0,0 +1,44 @@
+#include "../core/machine.hpp"
+#include "patches.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Reports Machine::tick throughput for each tick policy on the same patch.
+//
+// usage: bench_tick [size] [ticks]
+
+template <typename Policy>
+static double ticks_per_second(const std::string &patch, unsigned ticks) {
+  Machine m;
+  m.load_string(patch);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned i = 0; i < ticks; ++i)
+    m.tick<Policy>();
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return ticks / elapsed.count();
+}
+
+int main(int argc, char *argv[]) {
+  int size = argc > 1 ? atoi(argv[1]) : 256;
+  unsigned ticks = argc > 2 ? atoi(argv[2]) : 500;
+
+  printf("%dx%d grid, %u ticks\n", size, size, ticks);
+
+  for (auto &bench : BENCH_PATCHES) {
+    auto patch = tile_patch(bench.module, size, size);
+
+    printf("  %-8s annotated: %10.1f ticks/s\n", bench.name,
+           ticks_per_second<AnnotatedTick>(patch, ticks));
+    printf("  %-8s headless:  %10.1f ticks/s\n", bench.name,
+           ticks_per_second<HeadlessTick>(patch, ticks));
+  }
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "batch.hpp"
+#include "pool.hpp"
+#include "simd.hpp"
+#include "tsf.h"
+
+#include <array>
+#include <chrono>
+
+// Like Machine::run(): a tick every bpm / 15 video frames, audio_samples
+// holding the audio of one.
+static BatchStats render_job(BatchJob &job) {
+  BatchStats stats;
+
+  Machine m;
+  m.load_string(job.patch);
+
+  auto on_note = [&](unsigned tick, const ChangeSet::NoteEvent &event) {
+    if (job.on_note)
+      job.on_note(tick, event);
+  };
+
+  if (!job.on_audio) {
+    m.tick_n(job.ticks, on_note);
+  } else {
+    auto frames = m.audio_samples.size() / 2;
+    std::array<int16_t, Machine::AUDIO_SAMPLES> s16;
+    m.queue_notes = true;
+
+    for (unsigned t = 0; t < job.ticks; ++t) {
+      m.tick<HeadlessTick>();
+      for (auto &event : m.note_events)
+        on_note(m.ticks, event);
+      m.note_events.clear();
+
+      for (int f = 0; f < m.bpm / 15; ++f) {
+        tsf_render_float(m.sf, m.audio_samples.data(), (int)frames, 0);
+        m.audio_samples_s16(s16.data());
+        job.on_audio(s16.data(), frames);
+        stats.frames += frames;
+      }
+    }
+  }
+
+  stats.ticks = m.ticks;
+  return stats;
+}
+
+BatchStats render_batch(ThreadPool &pool, std::vector<BatchJob> &jobs) {
+  std::vector<BatchStats> done(jobs.size());
+  auto start = std::chrono::steady_clock::now();
+
+  pool.run(jobs.size(), [&](size_t i) { done[i] = render_job(jobs[i]); });
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  BatchStats total;
+  for (auto &stats : done) {
+    total.ticks += stats.ticks;
+    total.frames += stats.frames;
+  }
+  total.seconds = elapsed.count();
+  return total;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "machine.hpp"
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct ThreadPool;
+
+// A patch to render offline, see render_batch(). The callbacks are called by
+// the thread rendering the job, as it goes, so they only need to be safe
+// against the callbacks of other jobs.
+struct BatchJob {
+  std::string patch; // as Machine::load_string() takes it
+  unsigned ticks = 0;
+
+  // after each tick, the notes it started and ended, tick being the tick
+  // count after it
+  std::function<void(unsigned tick, const ChangeSet::NoteEvent &event)>
+      on_note;
+
+  // the stereo audio following each tick, the job renders notes only if not
+  // set
+  std::function<void(const int16_t *samples, size_t frames)> on_audio;
+};
+
+struct BatchStats {
+  uint64_t ticks = 0;
+  uint64_t frames = 0; // stereo sample frames rendered
+  double seconds = 0;
+};
+
+// Renders each job in a Machine of its own, the pool's threads taking the
+// next job as soon as they are done with one, and returns the totals.
+// Machines share nothing, their random numbers included, so a job renders
+// the same on any number of threads.
+BatchStats render_batch(ThreadPool &pool, std::vector<BatchJob> &jobs);
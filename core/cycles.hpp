@@ -0,0 +1,136 @@
+#pragma once
+#include "notes.hpp"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// The lcm of two periods of the tick count, 0 if either is 0 or if it does
+// not fit, 0 standing for a phase that never repeats.
+static inline uint32_t lcm_period(uint32_t a, uint32_t b) {
+  if (!a || !b)
+    return 0;
+
+  uint32_t x = a, y = b;
+  while (y) {
+    auto r = x % y;
+    x = y;
+    y = r;
+  }
+
+  uint64_t lcm = (uint64_t)a / x * b;
+  return lcm > UINT32_MAX ? 0 : (uint32_t)lcm;
+}
+
+// A note a tick played, see Machine::play_note().
+struct PlayedNote {
+  Note note;
+  bool mono;
+};
+
+// Watches the states a machine goes through for one it was in before. What a
+// tick does only depends on the state it starts from and on the tick count
+// modulo the clock periods it uses. Once a state comes back P ticks later and
+// P is a multiple of every period the ticks in between used, the ticks that
+// follow play the notes of the last P again, over and over:
+// Machine::fast_forward() plays them without ticking.
+//
+// States are told apart by their fingerprint, Machine::state_hash() with the
+// playing notes, and only the last WINDOW ticks are remembered, so longer
+// periods go unnoticed. Anything but a tick changing the state starts over.
+struct CycleFinder {
+  static const unsigned WINDOW = 4096;
+
+  struct Entry {
+    unsigned tick;  // tick count after the tick
+    uint64_t print; // fingerprint of the state it left
+    uint32_t clock_period;
+    std::vector<PlayedNote> played;
+  };
+
+  std::vector<Entry> entries; // ring of the last count ticks, newest at pos
+  size_t pos = 0;
+  size_t count = 0;
+  uint64_t last_state = 0; // state_hash() after the newest tick
+  std::unordered_map<uint64_t, unsigned> seen; // fingerprint -> tick
+  unsigned period = 0; // 0 until found
+
+  std::vector<PlayedNote> played; // by the tick being recorded
+
+  void clear() {
+    count = 0;
+    seen.clear();
+    period = 0;
+    played.clear();
+  }
+
+  // newest first, back < count
+  Entry &back(size_t back) {
+    return entries[(pos + WINDOW - back) % WINDOW];
+  }
+
+  // Before a tick: whatever changed the state since the last one makes what
+  // was recorded useless.
+  void check(uint64_t state) {
+    if (count && state != last_state)
+      clear();
+  }
+
+  // After a tick reaching tick count tick.
+  void record(unsigned tick, uint64_t state, uint64_t notes,
+              uint32_t clock_period) {
+    if (count && tick != back(0).tick + 1)
+      clear();
+
+    if (entries.empty())
+      entries.resize(WINDOW);
+
+    pos = (pos + 1) % WINDOW;
+    auto &entry = entries[pos];
+    if (count == WINDOW) {
+      auto old = seen.find(entry.print);
+      if (old != seen.end() && old->second == entry.tick)
+        seen.erase(old);
+    } else {
+      count++;
+    }
+
+    entry.tick = tick;
+    entry.print = state ^ notes;
+    entry.clock_period = clock_period;
+    entry.played.swap(played);
+    played.clear();
+    last_state = state;
+
+    if (period)
+      return;
+
+    auto it = seen.find(entry.print);
+    if (it != seen.end() && repeats(tick - it->second)) {
+      period = tick - it->second;
+      seen.clear();
+      return;
+    }
+
+    seen[entry.print] = tick;
+  }
+
+  // after Machine::fast_forward() played n ticks
+  void skip(unsigned n) {
+    for (size_t i = 0; i < count; ++i)
+      back(i).tick += n;
+    played.clear();
+  }
+
+  // whether the newest state repeats the one p ticks before, which has the
+  // same fingerprint
+  bool repeats(unsigned p) {
+    if (p >= count)
+      return false;
+
+    uint32_t clocks = 1;
+    for (size_t i = 0; i < p; ++i)
+      clocks = lcm_period(clocks, back(i).clock_period);
+
+    return clocks && p % clocks == 0;
+  }
+};
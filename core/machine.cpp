@@ -1,4 +1,6 @@
 #include "machine.hpp"
+#include "pool.hpp"
+#include "simd.hpp"
 #include "util.hpp"
 
 #include <algorithm>
@@ -7,73 +9,38 @@
 
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define TSF_IMPLEMENTATION
 #include "tsf.h"
 
-const std::map<char, const char *> Machine::OPERATOR_NAMES = {
-    {'A', "add"},       {'B', "subtract"}, {'C', "clock"},     {'D', "delay"},
-    {'E', "east"},      {'F', "if"},       {'G', "generator"}, {'H', "halt"},
-    {'I', "increment"}, {'J', "jumper"},   {'K', "konkat"},    {'L', "less"},
-    {'M', "multiply"},  {'N', "north"},    {'O', "read"},      {'P', "push"},
-    {'Q', "query"},     {'R', "random"},   {'S', "south"},     {'T', "track"},
-    {'U', "uclid"},     {'V', "variable"}, {'W', "west"},      {'X', "write"},
-    {'Y', "jymper"},    {'Z', "lerp"},     {'*', "bang"},      {'#', "comment"},
-    {':', "midi"},      {'%', "mono"},     {'!', "cc"},        {'?', "pb"},
-    {';', "udp"},       {'=', "osc"},      {'$', "self"},
-};
-
-// This is a minimal SoundFont with a single loopin saw-wave
-// sample/instrument/preset (484 bytes)
-const static unsigned char MinimalSoundFont[] = {
-#define TEN0 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-    'R', 'I',  'F',  'F',  220,  1,    0,    0,    's',  'f',  'b',  'k',  'L',
-    'I', 'S',  'T',  88,   1,    0,    0,    'p',  'd',  't',  'a',  'p',  'h',
-    'd', 'r',  76,   TEN0, TEN0, TEN0, TEN0, 0,    0,    0,    0,    TEN0, 0,
-    0,   0,    0,    0,    0,    0,    255,  0,    255,  0,    1,    TEN0, 0,
-    0,   0,    'p',  'b',  'a',  'g',  8,    0,    0,    0,    0,    0,    0,
-    0,   1,    0,    0,    0,    'p',  'm',  'o',  'd',  10,   TEN0, 0,    0,
-    0,   'p',  'g',  'e',  'n',  8,    0,    0,    0,    41,   0,    0,    0,
-    0,   0,    0,    0,    'i',  'n',  's',  't',  44,   TEN0, TEN0, 0,    0,
-    0,   0,    0,    0,    0,    0,    TEN0, 0,    0,    0,    0,    0,    0,
-    0,   1,    0,    'i',  'b',  'a',  'g',  8,    0,    0,    0,    0,    0,
-    0,   0,    2,    0,    0,    0,    'i',  'm',  'o',  'd',  10,   TEN0, 0,
-    0,   0,    'i',  'g',  'e',  'n',  12,   0,    0,    0,    54,   0,    1,
-    0,   53,   0,    0,    0,    0,    0,    0,    0,    's',  'h',  'd',  'r',
-    92,  TEN0, TEN0, 0,    0,    0,    0,    0,    0,    0,    50,   0,    0,
-    0,   0,    0,    0,    0,    49,   0,    0,    0,    34,   86,   0,    0,
-    60,  0,    0,    0,    1,    TEN0, TEN0, TEN0, TEN0, 0,    0,    0,    0,
-    0,   0,    0,    'L',  'I',  'S',  'T',  112,  0,    0,    0,    's',  'd',
-    't', 'a',  's',  'm',  'p',  'l',  100,  0,    0,    0,    86,   0,    119,
-    3,   31,   7,    147,  10,   43,   14,   169,  17,   58,   21,   189,  24,
-    73,  28,   204,  31,   73,   35,   249,  38,   46,   42,   71,   46,   250,
-    48,  150,  53,   242,  55,   126,  60,   151,  63,   108,  66,   126,  72,
-    207, 70,   86,   83,   100,  72,   74,   100,  163,  39,   241,  163,  59,
-    175, 59,   179,  9,    179,  134,  187,  6,    186,  2,    194,  5,    194,
-    15,  200,  6,    202,  96,   206,  159,  209,  35,   213,  213,  216,  45,
-    220, 221,  223,  76,   227,  221,  230,  91,   234,  242,  237,  105,  241,
-    8,   245,  118,  248,  32,   252};
-
 bool Machine::load_string(const std::string &data) {
   size_t first_eol = data.find('\n');
   if (first_eol == std::string::npos && data.empty())
     return false;
 
-  std::vector<Cell> row;
-  for (unsigned i = 0; i < data.size(); ++i) {
+  // The first line sets the grid width, shorter lines are padded with '.'
+  // and longer ones are truncated.
+  int w = first_eol == std::string::npos ? data.size() : first_eol;
+  int h = 0;
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    if (data[i] == '\n' || i + 1 == data.size())
+      h++;
+  }
+
+  width = height = 0;
+  set_size(w, h);
+
+  int x = 0, y = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
     if (data[i] == '\n') {
-      cells.push_back(std::move(row));
-      row = std::vector<Cell>();
-    } else {
-      Cell cell;
-      cell.c = data[i];
-      row.push_back(cell);
+      x = 0;
+      y++;
+    } else if (x < w) {
+      set_glyph(cell_index(x++, y), data[i]);
     }
   }
 
-  if (row.size())
-    cells.push_back(std::move(row));
-
   init(grid_w(), grid_h());
 
   return true;
@@ -81,9 +48,14 @@ bool Machine::load_string(const std::string &data) {
 
 std::string Machine::to_string() const {
   std::string out;
+  out.reserve((size_t)(grid_w() + 1) * grid_h());
+
   for (int y = 0; y < grid_h(); ++y) {
-    for (int x = 0; x < grid_w(); ++x) {
-      out.push_back(cells[y][x].c);
+    for (int x = 0; x < grid_w(); x += TILE) {
+      // empty tiles read as the shared empty tile
+      auto i = cell_index(x, y);
+      auto row = &tile(i).glyphs[tile_offset(i)];
+      out.append((const char *)row, std::min(TILE, grid_w() - x));
     }
     out.push_back('\n');
   }
@@ -91,19 +63,22 @@ std::string Machine::to_string() const {
   return out;
 }
 
+void Machine::prepare_soundfont(tsf *font) {
+  for (int i = 0; i < 7; ++i) {
+    // tsf_channel_set_presetnumber(font, i, 0, 0);
+    tsf_channel_set_bank(font, i, 0);
+  }
+
+  tsf_set_output(font, TSF_STEREO_INTERLEAVED, AUDIO_SAMPLE_RATE, 0);
+}
+
 void Machine::init(int width, int height) {
   if (!sf)
-    // sf = tsf_load_filename("/usr/share/soundfonts/FluidR3_GM.sf2");
-    sf = tsf_load_memory(MinimalSoundFont, sizeof(MinimalSoundFont));
+    // sf = open_soundfont("/usr/share/soundfonts/FluidR3_GM.sf2");
+    sf = open_soundfont();
 
   assert(sf);
-
-  for (int i = 0; i < 7; ++i) {
-    // tsf_channel_set_presetnumber(sf, i, 0, 0);
-    tsf_channel_set_bank(sf, i, 0);
-  }
-
-  tsf_set_output(sf, TSF_STEREO_INTERLEAVED, AUDIO_SAMPLE_RATE, 0);
+  prepare_soundfont(sf);
 
   set_size(width, height);
 
@@ -129,535 +104,1522 @@ void Machine::init(int width, int height) {
                         NULL};
   for (int y = 0; data[y] && y < grid_h(); ++y) {
     for (int x = 0; data[y][x] && x < grid_w(); ++x) {
-      cells[y][x].c = data[y][x];
+      set_glyph(cell_index(x, y), data[y][x]);
     }
   }
 #endif
 }
 
-void Machine::set_size(int width, int height) {
-  cells.resize(height);
-  cell_descs.resize(height);
-  for (auto &row : cells)
-    row.resize(width);
-  for (auto &row : cell_descs)
-    row.resize(width);
+void Machine::set_size(int new_width, int new_height) {
+  if (new_width == width && new_height == height)
+    return;
+
+  int old_width = width, old_height = height, old_tiles_w = tiles_w;
+  std::vector<uint32_t> old_ids, old_live;
+  std::vector<Tile> old_store;
+  old_ids.swap(tile_ids);
+  old_live.swap(live_tiles);
+  old_store.swap(tile_store);
+
+  width = new_width;
+  height = new_height;
+  tile_cols = (width + TILE - 1) / TILE;
+  tile_rows = (height + TILE - 1) / TILE;
+  tiles_w = tile_cols + 2 * GUARD_TILES;
+  tile_ids.assign((size_t)tiles_w * (tile_rows + 2 * GUARD_TILES), 0);
+  tile_store.assign(1, Tile());
+  tile_descs.assign(1, std::vector<CellDesc>());
+  free_tiles.clear();
+  live_tiles.clear();
+  op_tile_words = (tile_cols + 63) / 64;
+  op_tiles.assign((size_t)tile_rows * op_tile_words, 0);
+  tile_region.assign(tile_ids.size(), -1);
+  reach_count.assign(tile_ids.size(), 0);
+  region_backoff = region_wait = 0;
+  shadows.clear();
+  plan_valid = false;
+  hash = 0;
+
+  // keep whatever still fits in the new dimensions
+  for (auto slot : old_live) {
+    auto &t = old_store[old_ids[slot]];
+    auto x0 = ((int)(slot % old_tiles_w) - GUARD_TILES) * TILE;
+    auto y0 = ((int)(slot / old_tiles_w) - GUARD_TILES) * TILE;
+
+    for (int offset = 0; offset < TILE_CELLS; ++offset) {
+      int x = x0 + (offset & (TILE - 1));
+      int y = y0 + (offset >> TILE_SHIFT);
+      if (x < 0 || y < 0 || x >= std::min(old_width, width) ||
+          y >= std::min(old_height, height))
+        continue;
+
+      // descriptors are not carried over
+      unsigned char f = t.flags[offset] & ~CF_HAS_DESC;
+      if (t.glyphs[offset] == '.' && !f)
+        continue;
+
+      auto i = cell_index(x, y);
+      set_glyph(i, t.glyphs[offset]);
+      flags_at(i) = f;
+    }
+  }
+}
+
+void Machine::alloc_tile(size_t slot) {
+  // regions may be reading tile_store
+  assert(!ticking_regions);
+
+  uint32_t id;
+  if (free_tiles.empty()) {
+    id = tile_store.size();
+    tile_store.push_back(Tile());
+    // its descriptors are only allocated if a tick annotates it
+    tile_descs.emplace_back();
+  } else {
+    id = free_tiles.back();
+    free_tiles.pop_back();
+    tile_store[id] = Tile();
+  }
+
+  tile_ids[slot] = id;
+  tile_store[id].live_pos = live_tiles.size();
+  live_tiles.push_back(slot);
+}
+
+void Machine::free_tile(size_t slot) {
+  auto id = tile_ids[slot];
+  auto pos = tile_store[id].live_pos;
+
+  assert(tile_store[id].filled == 0 && tile_store[id].ops == 0);
+
+  live_tiles[pos] = live_tiles.back();
+  tile_store[tile_ids[live_tiles[pos]]].live_pos = pos;
+  live_tiles.pop_back();
+
+  free_tiles.push_back(id);
+  tile_ids[slot] = 0;
+}
+
+void Machine::report_tile(size_t slot) {
+  static_assert(sizeof(Cell::Glyph) == 1, "glyphs must be plain bytes");
+
+  auto id = tile_ids[slot];
+  auto &t = tile_store[id];
+  auto &s = shadows[id];
+  auto x0 = ((int)(slot % tiles_w) - GUARD_TILES) * TILE;
+  auto y0 = ((int)(slot / tiles_w) - GUARD_TILES) * TILE;
+
+  for (int first = 0; first < TILE_CELLS; first += TILE) {
+    if (!memcmp(&t.glyphs[first], &s.glyphs[first], TILE) &&
+        !memcmp(&t.flags[first], &s.flags[first], TILE))
+      continue;
+
+    for (int offset = first; offset < first + TILE; ++offset) {
+      if (t.glyphs[offset] == s.glyphs[offset] &&
+          t.flags[offset] == s.flags[offset])
+        continue;
+
+      s.glyphs[offset] = t.glyphs[offset];
+      s.flags[offset] = t.flags[offset];
+
+      // reads past the edges leave flags outside the grid
+      int x = x0 + (offset & (TILE - 1));
+      int y = y0 + (offset >> TILE_SHIFT);
+      if (is_valid(x, y))
+        changes.cells.push_back({x, y, t.glyphs[offset], t.flags[offset]});
+    }
+  }
+}
+
+void Machine::note_on(const Note &note) {
+  if (synthesize)
+    tsf_channel_note_on(sf, note.channel, note.key, note.velocity);
+  if (queue_notes)
+    note_events.push_back({note, true});
+  if (track_changes)
+    changes.notes.push_back({note, true});
+}
+
+void Machine::note_off(const Note &note) {
+  if (synthesize)
+    tsf_channel_note_off(sf, note.channel, note.key);
+  if (queue_notes)
+    note_events.push_back({note, false});
+  if (track_changes)
+    changes.notes.push_back({note, false});
+}
+
+void Machine::use_clock(int x, int y, uint32_t period) {
+  auto &lcm = ticking_regions
+                  ? regions[tile_region[tile_slot(cell_index(x, y))]]
+                        .clock_period
+                  : clock_period;
+  lcm = lcm_period(lcm, period);
+}
+
+uint64_t Machine::full_state_hash() const {
+  uint64_t grid = 0;
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      grid ^= glyph_key(cell_index(x, y), peek_cell(x, y));
+
+  uint64_t values = 0;
+  for (int name = 0; name < 256; ++name)
+    values ^= variable_key(name, variables.values[name]);
+
+  auto phase = clock_period ? ticks % clock_period : ticks;
+  return grid ^ values ^ zobrist_key((uint64_t)clock_period << 32 | phase);
+}
+
+void Machine::play_note(const Note &note, bool mono) {
+  if (mono)
+    notes.cut_channel(note.channel,
+                      [&](const Note &playing) { note_off(playing); });
+
+  notes.add(note);
+  note_on(note);
+  if (find_cycles)
+    cycles.played.push_back({note, mono});
+
+  if (mono) {
+    if (synthesize)
+      tsf_channel_set_pan(sf, note.channel, ticks % 2 == 0);
+    // played after the regions, see tick_regions()
+    clock_period = lcm_period(clock_period, 2);
+  }
+}
+
+void Machine::queue_note(int x, int y, const Note &note, bool mono) {
+  auto &region = regions[tile_region[tile_slot(cell_index(x, y))]];
+  region.notes.push_back({region.scan_y, region.scan_x, note, mono});
+}
+
+bool Machine::next_op_in_next_tiles(int &x, int &y) const {
+  while (y < height) {
+    if (x < width) {
+      // operators in the tiles of the row after the one of x
+      auto words = &op_tiles[(size_t)(y >> TILE_SHIFT) * op_tile_words];
+      for (int tx = (x >> TILE_SHIFT) + 1; tx < tile_cols;) {
+        auto tiles = words[tx / 64] & (~(uint64_t)0 << (tx % 64));
+        if (!tiles) {
+          tx = (tx / 64 + 1) * 64;
+          continue;
+        }
+
+        tx = tx / 64 * 64 + count_trailing_zeros(tiles);
+        auto bits = tile(cell_index(tx * TILE, y)).op_rows[y & (TILE - 1)];
+        if (bits) {
+          x = tx * TILE + count_trailing_zeros(bits);
+          return true;
+        }
+        tx++;
+      }
+    }
+
+    x = 0;
+    y++;
+
+    // skip tile rows without operators
+    while (y < height && (y & (TILE - 1)) == 0) {
+      auto row = &op_tiles[(size_t)(y >> TILE_SHIFT) * op_tile_words];
+      if (std::any_of(row, row + op_tile_words,
+                      [](uint64_t w) { return w != 0; }))
+        break;
+      y += TILE;
+    }
+
+    if (next_op_in_tile(x, y))
+      return true;
+  }
+
+  return false;
 }
 
 void Machine::reset() {
-  int w = cells[0].size();
-  int h = cells.size();
+  // drop every tile
+  int w = width, h = height;
+  width = height = 0;
+  set_size(w, h);
+  variables.clear();
 
-  cells.clear();
-  init(w, h);
+  init(width, height);
 
   frames = 0;
   ticks = 0;
 }
 
+void Machine::use_next_soundfont() {
+  // a fade still going is cut short
+  if (fading_sf)
+    retired_sf.push_back(std::move(fading_sf));
+  fading_sf = std::move(sf);
+  sf = std::move(next_sf);
+  fade_frames = SOUNDFONT_FADE;
+  fade_samples.resize(audio_samples.size());
+
+  if (!synthesize)
+    return;
+
+  for (auto i = notes.order.head; i != NoteSchedule::NIL;
+       i = notes.slots[i].order.next) {
+    auto &note = notes.slots[i].note;
+    tsf_channel_set_pan(sf, note.channel,
+                        tsf_channel_get_pan(fading_sf, note.channel));
+    tsf_channel_note_on(sf, note.channel, note.key, note.velocity);
+  }
+}
+
+void Machine::audio_samples_s16(int16_t *out) const {
+  simd_float_to_s16(audio_samples.data(), out, audio_samples.size());
+}
+
 void Machine::run() {
-  if (frames % (bpm / 15) == 0)
+  if (frames % (bpm / 15) == 0) {
+    if (next_sf)
+      use_next_soundfont();
     tick();
+  }
+
+  auto count = (int)audio_samples.size() / 2;
+  tsf_render_float(sf, audio_samples.data(), count, 0);
+
+  if (fading_sf) {
+    // mixed in at a gain going down to 0 over the fade
+    tsf_render_float(fading_sf, fade_samples.data(), count, 0);
+
+    for (int i = 0; i < count && fade_frames > 0; ++i, --fade_frames) {
+      auto gain = fade_frames * (1.f / SOUNDFONT_FADE);
+      audio_samples[2 * i] += fade_samples[2 * i] * gain;
+      audio_samples[2 * i + 1] += fade_samples[2 * i + 1] * gain;
+    }
+
+    if (fade_frames == 0)
+      retired_sf.push_back(std::move(fading_sf));
+  }
 
-  tsf_render_short(sf, audio_samples.data(), audio_samples.size() / 2);
   frames++;
 }
 
+static bool all_zero(const unsigned char *p, size_t count) {
+  uint64_t any = 0;
+  for (size_t i = 0; i + 8 <= count; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, 8);
+    any |= word;
+  }
+  return any == 0;
+}
+
 static void prepare_cells(Machine &machine) {
-  for (auto &rows : machine.cells) {
-    for (auto &cell : rows) {
-      if (UNLIKELY(isdigit(cell.c)))
-        cell.flags = CF_IS_LITERAL;
-      else
-        cell.flags = 0;
+  static_assert(sizeof(Cell::Glyph) == 1, "glyphs must be plain bytes");
+
+  // backwards, free_tile() moves the last live tile into the freed position
+  for (size_t n = machine.live_tiles.size(); n-- > 0;) {
+    auto slot = machine.live_tiles[n];
+    auto &t = machine.tile_store[machine.tile_ids[slot]];
+
+    // empty tiles nothing touched during the last tick go back to the pool,
+    // and guard tiles whatever the reads left in their flags
+    if (t.filled == 0 &&
+        (machine.is_guard_slot(slot) || all_zero(t.flags, TILE_CELLS))) {
+      // reporting it leaves its shadow empty for the next tile with its id,
+      // the flags of guard cells were never reported
+      memset(t.flags, 0, TILE_CELLS);
+      if (machine.track_changes)
+        machine.report_tile(slot);
+      machine.free_tile(slot);
+      continue;
     }
+
+    // quiet tiles keep the flags of the last tick
+    if (!t.quiet)
+      simd_flag_digits((const char *)t.glyphs, t.flags, TILE_CELLS,
+                       CF_IS_LITERAL);
   }
-  for (auto &rows : machine.cell_descs)
-    for (auto &desc : rows)
-      desc = "empty";
 }
 
 static void collect_old_notes(Machine &machine) {
-  for (auto &note : machine.notes) {
-    note.length--;
+  machine.notes.advance([&](const Note &note) { machine.note_off(note); });
+}
+
+// Port names in cell_desc() order, the first one being port 1. A name ending
+// in '*' stands for 36 ports suffixed with their base 36 index.
+static constexpr const char *PORTS_A_B[] = {"a", "b", "output", nullptr};
+static constexpr const char *PORTS_RATE_MOD[] = {"rate", "mod", "output",
+                                                 nullptr};
+static constexpr const char *PORTS_G_Q[] = {"x",   "y",    "len",
+                                            "in*", "out*", nullptr};
+static constexpr const char *PORTS_I[] = {"step", "mod", "output", nullptr};
+static constexpr const char *PORTS_J_Y[] = {"input", "output", nullptr};
+static constexpr const char *PORTS_K[] = {"len", "read*", "out*", nullptr};
+static constexpr const char *PORTS_O_X[] = {"x", "y", "read", "output",
+                                            nullptr};
+static constexpr const char *PORTS_P[] = {"key", "len", "read", "output",
+                                          nullptr};
+static constexpr const char *PORTS_T[] = {"key", "len", "val", "output",
+                                          nullptr};
+static constexpr const char *PORTS_R[] = {"min", "max", "output", nullptr};
+static constexpr const char *PORTS_V[] = {"write", "read", "output", nullptr};
+static constexpr const char *PORTS_Z[] = {"rate", "target", "output", nullptr};
+static constexpr const char *PORTS_NOTE[] = {
+    "channel", "octave", "note", "velocity", "length", nullptr};
+static constexpr const char *PORTS_NONE[] = {nullptr};
+
+template <typename Policy>
+static void tick_add(Machine &m, int x, int y) {
+  char ca = m.read_cell<Policy>(x - 1, y, cell_desc('A', 1));
+  char cb = m.read_locked<Policy>(x + 1, y, cell_desc('A', 2));
+  int a = b36_to_int(ca, 0);
+  int b = b36_to_int(cb, 0);
+  m.write_locked<Policy>(x, y + 1, int_to_b36(a + b, is_upper_ch(cb)),
+                         cell_desc('A', 3));
+}
+
+template <typename Policy>
+static void tick_subtract(Machine &m, int x, int y) {
+  char ca = m.read_cell<Policy>(x - 1, y, cell_desc('B', 1));
+  char cb = m.read_locked<Policy>(x + 1, y, cell_desc('B', 2));
+  int a = b36_to_int(ca, 0);
+  int b = b36_to_int(cb, 0);
+
+  if (b > a)
+    m.write_locked<Policy>(x, y + 1, int_to_b36(b - a, is_upper_ch(cb)),
+                           cell_desc('B', 3));
+  else
+    m.write_locked<Policy>(x, y + 1, int_to_b36(a - b, is_upper_ch(cb)),
+                           cell_desc('B', 3));
+}
 
-    if (note.length < 1)
-      tsf_channel_note_off(machine.sf, note.channel, note.key);
+template <typename Policy>
+static void tick_clock(Machine &m, int x, int y) {
+  char ratec = m.read_cell<Policy>(x - 1, y, cell_desc('C', 1));
+  char modc = m.read_locked<Policy>(x + 1, y, cell_desc('C', 2));
+
+  int rate = b36_to_int(ratec, 1);
+  int mod = b36_to_int(modc, 10);
+
+  if (rate < 1)
+    rate = 1;
+
+  if (mod < 2)
+    m.write_locked<Policy>(x, y + 1, '0', cell_desc('C', 3));
+  else {
+    char resc = m.peek_cell(x, y + 1);
+    int res = b36_to_int(resc, 0);
+
+    if (m.ticks % rate == 0)
+      res = (res + 1) % mod;
+    m.use_clock(x, y, rate);
+
+    m.write_locked<Policy>(x, y + 1, int_to_b36(res, is_upper_ch(modc)),
+                           cell_desc('C', 3));
   }
+}
+
+template <typename Policy>
+static void tick_delay(Machine &m, int x, int y) {
+  char ratec = m.read_cell<Policy>(x - 1, y, cell_desc('D', 1));
+  char modc = m.read_locked<Policy>(x + 1, y, cell_desc('D', 2));
 
-  auto dead_notes = std::remove_if(machine.notes.begin(), machine.notes.end(),
-                                   [](Note &note) { return note.length < 1; });
+  int rate = b36_to_int(ratec, 1);
+  int mod = b36_to_int(modc, 8);
 
-  machine.notes.erase(dead_notes, machine.notes.end());
+  if (rate < 1)
+    rate = 1;
+
+  bool bang = mod != 0 && (mod == 1 || (m.ticks % (rate * mod) == 0));
+  if (mod > 1)
+    m.use_clock(x, y, rate * mod);
+  m.write_locked<Policy>(x, y + 1, (bang ? '*' : '.'), cell_desc('D', 3));
 }
 
-void Machine::tick() {
-  prepare_cells(*this);
-  collect_old_notes(*this);
+template <typename Policy>
+static void tick_east(Machine &m, int x, int y) {
+  m.move_operation(x, y, 1, 0);
+}
 
-  for (int y = 0; y < grid_h(); ++y) {
-    for (int x = 0; x < grid_w(); ++x) {
-      auto cell = &cells[y][x];
+template <typename Policy>
+static void tick_if(Machine &m, int x, int y) {
+  char ca = m.read_cell<Policy>(x - 1, y, cell_desc('F', 1));
+  char cb = m.read_locked<Policy>(x + 1, y, cell_desc('F', 2));
+  m.write_locked<Policy>(x, y + 1, ca == cb ? '*' : '.', cell_desc('F', 3));
+}
 
-      if (cell->c == '.' || cell->flags & CF_WAS_TICKED || isdigit(cell->c))
-        continue;
+template <typename Policy>
+static void tick_generator(Machine &m, int x, int y) {
+  char cx = m.read_cell<Policy>(x - 3, y, cell_desc('G', 1));
+  char cy = m.read_cell<Policy>(x - 2, y, cell_desc('G', 2));
+  char clen = m.read_cell<Policy>(x - 1, y, cell_desc('G', 3));
 
-      auto tick_char = cell->c;
+  int x_ = b36_to_int(cx, 0);
+  int y_ = b36_to_int(cy, 0);
+  int len = b36_to_int(clen, 1);
 
-      if (cell->flags & CF_WAS_BANGED)
-        tick_char = cell->c.as_upper();
+  if (len < 1)
+    len = 1;
 
-      if (islower(tick_char) ||
-          ((cell->flags & CF_IS_LITERAL) && tick_char != '*'))
-        continue;
+  for (int i = 0; i < len; ++i) {
+    auto in = m.read_locked<Policy>(x + 1 + i, y, cell_desc('G', 4 + i));
+    m.write_locked<Policy>(x + x_ + i, y + y_ + 1, in, cell_desc('G', 40 + i));
+  }
+}
 
-      cell_descs[y][x] = OPERATOR_NAMES.at(tick_char);
+template <typename Policy>
+static void tick_halt(Machine &m, int x, int y) {
+  m.lock_cell(x, y + 1);
+}
 
-      tick_cell(tick_char, x, y, cell);
-    }
+template <typename Policy>
+static void tick_increment(Machine &m, int x, int y) {
+  char stepc = m.read_cell<Policy>(x - 1, y, cell_desc('I', 1));
+  char modc = m.read_locked<Policy>(x + 1, y, cell_desc('I', 2));
+
+  int step = b36_to_int(stepc, 1);
+  int mod = b36_to_int(modc, 10);
+
+  if (mod < 1)
+    mod = 10;
+
+  char resc = m.peek_cell(x, y + 1);
+  int res = b36_to_int(resc, 0);
+
+  res = (res + step) % mod;
+
+  m.write_locked<Policy>(x, y + 1, int_to_b36(res, is_upper_ch(modc)),
+                         cell_desc('I', 3));
+}
+
+template <typename Policy>
+static void tick_jumper(Machine &m, int x, int y) {
+  m.write_locked<Policy>(x, y + 1,
+                         m.read_cell<Policy>(x, y - 1, cell_desc('J', 1)),
+                         cell_desc('J', 2));
+}
+
+template <typename Policy>
+static void tick_konkat(Machine &m, int x, int y) {
+  char clen = m.read_cell<Policy>(x - 1, y, cell_desc('K', 1));
+  int len = b36_to_int(clen, 1);
+
+  if (len < 1)
+    len = 1;
+
+  for (int i = 0; i < len; ++i) {
+    char varc = m.read_locked<Policy>(x + 1 + i, y, cell_desc('K', 2 + i));
+    if (varc == '.')
+      m.write_locked<Policy>(x + 1 + i, y + 1, '.', cell_desc('K', 38 + i));
+    else
+      m.write_locked<Policy>(x + 1 + i, y + 1, m.variables[varc],
+                             cell_desc('K', 38 + i));
   }
+}
 
-  ticks++;
+template <typename Policy>
+static void tick_less(Machine &m, int x, int y) {
+  char ca = m.read_cell<Policy>(x - 1, y, cell_desc('L', 1));
+  char cb = m.read_locked<Policy>(x + 1, y, cell_desc('L', 2));
+
+  char res = to_lower_ch(ca) < to_lower_ch(cb) ? ca : cb;
+
+  m.write_locked<Policy>(x, y + 1,
+                         is_upper_ch(cb) ? to_upper_ch(res) : to_lower_ch(res),
+                         cell_desc('L', 3));
 }
 
-void Machine::tick_cell(char effective_c, int x, int y, Cell *cell) {
-  if (cell->flags & CF_WAS_TICKED)
-    return;
+template <typename Policy>
+static void tick_multiply(Machine &m, int x, int y) {
+  char ca = m.read_cell<Policy>(x - 1, y, cell_desc('M', 1));
+  char cb = m.read_locked<Policy>(x + 1, y, cell_desc('M', 2));
+  int a = b36_to_int(ca, 0);
+  int b = b36_to_int(cb, 0);
+  m.write_locked<Policy>(x, y + 1, int_to_b36(a * b, is_upper_ch(cb)),
+                         cell_desc('M', 3));
+}
+
+template <typename Policy>
+static void tick_north(Machine &m, int x, int y) {
+  m.move_operation(x, y, 0, -1);
+}
+
+template <typename Policy>
+static void tick_read(Machine &m, int x, int y) {
+  char cx = m.read_cell<Policy>(x - 2, y, cell_desc('O', 1));
+  char cy = m.read_cell<Policy>(x - 1, y, cell_desc('O', 2));
+
+  int x_ = b36_to_int(cx, 0);
+  int y_ = b36_to_int(cy, 0);
+
+  m.write_locked<Policy>(
+      x, y + 1, m.read_locked<Policy>(x + 1 + x_, y + y_, cell_desc('O', 3)),
+      cell_desc('O', 4));
+}
+
+template <typename Policy>
+static void tick_push(Machine &m, int x, int y) {
+  char ckey = m.read_cell<Policy>(x - 2, y, cell_desc('P', 1));
+  char clen = m.read_cell<Policy>(x - 1, y, cell_desc('P', 2));
+  char cread = m.read_locked<Policy>(x + 1, y, cell_desc('P', 3));
+
+  int key = b36_to_int(ckey, 0);
+  int len = b36_to_int(clen, 0);
+
+  if (len < 1)
+    len = 1;
+
+  key %= len;
+
+  for (int i = 0; i < len; ++i)
+    m.lock_cell(x + i, y + 1);
+
+  m.write_locked<Policy>(x + key, y + 1, cread, cell_desc('P', 4));
+}
+
+template <typename Policy>
+static void tick_query(Machine &m, int x, int y) {
+  char cx = m.read_cell<Policy>(x - 3, y, cell_desc('Q', 1));
+  char cy = m.read_cell<Policy>(x - 2, y, cell_desc('Q', 2));
+  char clen = m.read_cell<Policy>(x - 1, y, cell_desc('Q', 3));
+
+  int x_ = b36_to_int(cx, 0);
+  int y_ = b36_to_int(cy, 0);
+  int len = b36_to_int(clen, 1);
+
+  if (len < 1)
+    len = 1;
+
+  for (int i = 0; i < len; ++i) {
+    // Q reads up to 70 cells away, past the border
+    auto in = m.is_valid(x + x_ + i + 1, y + y_)
+                  ? m.read_locked<Policy>(x + x_ + i + 1, y + y_,
+                                          cell_desc('Q', 4 + i))
+                  : '.';
+    m.write_locked<Policy>(x + i - len + 1, y + 1, in, cell_desc('Q', 40 + i));
+  }
+}
+
+template <typename Policy>
+static void tick_random(Machine &m, int x, int y) {
+  char cmin = m.read_cell<Policy>(x - 1, y, cell_desc('R', 1));
+  char cmax = m.read_locked<Policy>(x + 1, y, cell_desc('R', 2));
+
+  int min_ = b36_to_int(cmin, 0);
+  int max_ = b36_to_int(cmax, 35);
+
+  int res = min_ + (m.rng.next() / (float)Random::MAX) * (max_ - min_ + 1);
+  m.use_clock(x, y, 0);
+  m.write_locked<Policy>(x, y + 1, int_to_b36(res, is_upper_ch(cmax)),
+                         cell_desc('R', 3));
+}
+
+template <typename Policy>
+static void tick_south(Machine &m, int x, int y) {
+  m.move_operation(x, y, 0, 1);
+}
+
+template <typename Policy>
+static void tick_track(Machine &m, int x, int y) {
+  char ckey = m.read_cell<Policy>(x - 2, y, cell_desc('T', 1));
+  char clen = m.read_cell<Policy>(x - 1, y, cell_desc('T', 2));
+
+  int key = b36_to_int(ckey, 0);
+  int len = b36_to_int(clen, 0);
+
+  if (len < 1)
+    len = 1;
+
+  key %= len;
+
+  char cval = m.read_locked<Policy>(x + 1 + key, y, cell_desc('T', 3));
+
+  for (int i = 0; i < len; ++i)
+    m.lock_cell(x + 1 + i, y);
+
+  m.write_locked<Policy>(x, y + 1, cval, cell_desc('T', 4));
+}
+
+template <typename Policy>
+static void tick_variable(Machine &m, int x, int y) {
+  char cwrite = m.read_cell<Policy>(x - 1, y, cell_desc('V', 1));
+  char cread = m.read_locked<Policy>(x + 1, y, cell_desc('V', 2));
+
+  if (cwrite != '.')
+    m.variables.set(cwrite, cread);
+  else if (cread != '.')
+    m.write_locked<Policy>(x, y + 1, m.variables[cread], cell_desc('V', 3));
+}
+
+template <typename Policy>
+static void tick_west(Machine &m, int x, int y) {
+  m.move_operation(x, y, -1, 0);
+}
 
-  cell->flags |= CF_WAS_TICKED;
-
-  switch (effective_c) {
-  case 'A': {
-    char ca = read_cell(x - 1, y, "A-a");
-    char cb = read_locked(x + 1, y, "A-b");
-    int a = b36_to_int(ca, 0);
-    int b = b36_to_int(cb, 0);
-    write_locked(x, y + 1, int_to_b36(a + b, isupper(cb)), "A-output");
-    break;
-  }
-  case 'B': {
-    char ca = read_cell(x - 1, y, "B-a");
-    char cb = read_locked(x + 1, y, "B-b");
-    int a = b36_to_int(ca, 0);
-    int b = b36_to_int(cb, 0);
-
-    if (b > a)
-      write_locked(x, y + 1, int_to_b36(b - a, isupper(cb)), "B-output");
+template <typename Policy>
+static void tick_write(Machine &m, int x, int y) {
+  char cx = m.read_cell<Policy>(x - 2, y, cell_desc('X', 1));
+  char cy = m.read_cell<Policy>(x - 1, y, cell_desc('X', 2));
+
+  int x_ = b36_to_int(cx, 0);
+  int y_ = b36_to_int(cy, 0);
+
+  m.write_locked<Policy>(x + x_, y + y_ + 1,
+                         m.read_locked<Policy>(x + 1, y, cell_desc('X', 3)),
+                         cell_desc('X', 4));
+}
+
+template <typename Policy>
+static void tick_jymper(Machine &m, int x, int y) {
+  m.write_locked<Policy>(x + 1, y,
+                         m.read_cell<Policy>(x - 1, y, cell_desc('Y', 1)),
+                         cell_desc('Y', 2));
+}
+
+template <typename Policy>
+static void tick_lerp(Machine &m, int x, int y) {
+  char ratec = m.read_cell<Policy>(x - 1, y, cell_desc('Z', 1));
+  char targetc = m.read_locked<Policy>(x + 1, y, cell_desc('Z', 2));
+
+  int rate = b36_to_int(ratec, 1);
+  int target = b36_to_int(targetc, 0);
+
+  char resc = m.peek_cell(x, y + 1);
+  int res = b36_to_int(resc, 0);
+
+  if (res > target) {
+    res = res - rate;
+    if (res < target)
+      res = target;
+  } else if (res < target) {
+    res = res + rate;
+    if (res > target)
+      res = target;
+  }
+  m.write_locked<Policy>(x, y + 1, int_to_b36(res, is_upper_ch(target)),
+                         cell_desc('Z', 3));
+}
+
+template <typename Policy>
+static void tick_bang(Machine &m, int x, int y) {
+  auto self = m.cell_index(x, y);
+
+  // this '*' or the operators it bangs may have been written this tick
+  m.reach_op<Policy>('*', x, y);
+
+  if ((m.flags_at(self) & CF_IS_LITERAL) == 0)
+    m.set_glyph(self, '.');
+
+  // XXX: Orca and Orca-c only bang the neighbors to the north and west
+  if (m.is_valid(x, y - 1)) {
+    auto neigh = m.cell_index(x, y - 1);
+    m.reach_op<Policy>(m.glyph_at(neigh).as_upper(), x, y - 1);
+    m.flags_at(neigh) |= CF_WAS_BANGED;
+    m.tick_cell<Policy>(m.glyph_at(neigh).as_upper(), x, y - 1);
+  }
+
+  if (m.is_valid(x - 1, y)) {
+    auto neigh = m.cell_index(x - 1, y);
+    m.reach_op<Policy>(m.glyph_at(neigh).as_upper(), x - 1, y);
+    m.flags_at(neigh) |= CF_WAS_BANGED;
+    m.tick_cell<Policy>(m.glyph_at(neigh).as_upper(), x - 1, y);
+  }
+
+  if (m.is_valid(x, y + 1))
+    m.flags_at(m.cell_index(x, y + 1)) |= CF_WAS_BANGED;
+
+  if (m.is_valid(x + 1, y))
+    m.flags_at(m.cell_index(x + 1, y)) |= CF_WAS_BANGED;
+}
+
+template <typename Policy>
+static void tick_comment(Machine &m, int x, int y) {
+  int end = x;
+  while (end + 1 < m.grid_w() && m.peek_cell(++end, y) != '#')
+    ;
+
+  // its end may have been overwritten this tick
+  m.reach_into<Policy>(x, y, end, y);
+
+  for (int i = x; i <= end; ++i)
+    m.lock_cell(i, y);
+}
+
+template <typename Policy>
+static void tick_midi(Machine &m, int x, int y) {
+  auto self = m.cell_index(x, y);
+
+  char channelc = m.read_locked<Policy>(x + 1, y, cell_desc(':', 1));
+  char octavec = m.read_locked<Policy>(x + 2, y, cell_desc(':', 2));
+  char notec = m.read_locked<Policy>(x + 3, y, cell_desc(':', 3));
+  char velocityc = m.read_locked<Policy>(x + 4, y, cell_desc(':', 4));
+  char lengthc = m.read_locked<Policy>(x + 5, y, cell_desc(':', 5));
+
+  int channel = b36_to_int(channelc, 0);
+  int octave = b36_to_int(octavec, 0);
+  int velocity = b36_to_int(velocityc, 15);
+  int length = b36_to_int(lengthc, 1);
+
+  if (m.flags_at(self) & CF_WAS_BANGED) {
+    Note n;
+    n.key = note_octave0_to_key(notec, octave);
+    n.channel = channel;
+    n.velocity = std::min(velocity / 16.0f, 16.0f);
+    n.length = length; // length % g
+    // printf(": %c + %i -> %i\n", notec, octave, n.key);
+    if (Policy::isolated)
+      m.queue_note(x, y, n, false);
     else
-      write_locked(x, y + 1, int_to_b36(a - b, isupper(cb)), "B-output");
-    break;
+      m.play_note(n, false);
   }
-  case 'C': {
-    char ratec = read_cell(x - 1, y, "C-rate");
-    char modc = read_locked(x + 1, y, "C-mod");
+}
 
-    int rate = b36_to_int(ratec, 1);
-    int mod = b36_to_int(modc, 10);
+template <typename Policy>
+static void tick_mono(Machine &m, int x, int y) {
+  auto self = m.cell_index(x, y);
+
+  char channelc = m.read_locked<Policy>(x + 1, y, cell_desc('%', 1));
+  char octavec = m.read_locked<Policy>(x + 2, y, cell_desc('%', 2));
+  char notec = m.read_locked<Policy>(x + 3, y, cell_desc('%', 3));
+  char velocityc = m.read_locked<Policy>(x + 4, y, cell_desc('%', 4));
+  char lengthc = m.read_locked<Policy>(x + 5, y, cell_desc('%', 5));
+
+  int channel = b36_to_int(channelc, 0);
+  int octave = b36_to_int(octavec, 0);
+  int velocity = b36_to_int(velocityc, 15);
+  int length = b36_to_int(lengthc, 1);
+
+  if (m.flags_at(self) & CF_WAS_BANGED) {
+    Note n;
+    n.key = note_octave0_to_key(notec, octave);
+    n.channel = channel;
+    n.velocity = std::min(velocity / 16.0f, 16.0f);
+    n.length = length; // length % g
+
+    // printf("%% %c + %i -> %i\n", notec, octave, n.key);
+    if (Policy::isolated)
+      m.queue_note(x, y, n, true);
+    else
+      m.play_note(n, true);
+  }
+}
 
-    if (rate < 1)
-      rate = 1;
+typedef void (*OperatorTick)(Machine &m, int x, int y);
 
-    if (mod < 2)
-      write_locked(x, y + 1, '0', "C-output");
-    else {
-      char resc = peek_cell(x, y + 1);
-      int res = b36_to_int(resc, 0);
+struct OperatorDef {
+  const char *name; // nullptr for glyphs that are not operators
+  const char *const *ports;
+  OperatorTick tick; // nullptr for operators that do nothing
+};
 
-      if (ticks % rate == 0)
-        res = (res + 1) % mod;
+template <typename Policy> constexpr OperatorDef operator_def(int c) {
+  // clang-format off
+  return c == 'A' ? OperatorDef{"add", PORTS_A_B, tick_add<Policy>}
+       : c == 'B' ? OperatorDef{"subtract", PORTS_A_B, tick_subtract<Policy>}
+       : c == 'C' ? OperatorDef{"clock", PORTS_RATE_MOD, tick_clock<Policy>}
+       : c == 'D' ? OperatorDef{"delay", PORTS_RATE_MOD, tick_delay<Policy>}
+       : c == 'E' ? OperatorDef{"east", PORTS_NONE, tick_east<Policy>}
+       : c == 'F' ? OperatorDef{"if", PORTS_A_B, tick_if<Policy>}
+       : c == 'G' ? OperatorDef{"generator", PORTS_G_Q, tick_generator<Policy>}
+       : c == 'H' ? OperatorDef{"halt", PORTS_NONE, tick_halt<Policy>}
+       : c == 'I' ? OperatorDef{"increment", PORTS_I, tick_increment<Policy>}
+       : c == 'J' ? OperatorDef{"jumper", PORTS_J_Y, tick_jumper<Policy>}
+       : c == 'K' ? OperatorDef{"konkat", PORTS_K, tick_konkat<Policy>}
+       : c == 'L' ? OperatorDef{"less", PORTS_A_B, tick_less<Policy>}
+       : c == 'M' ? OperatorDef{"multiply", PORTS_A_B, tick_multiply<Policy>}
+       : c == 'N' ? OperatorDef{"north", PORTS_NONE, tick_north<Policy>}
+       : c == 'O' ? OperatorDef{"read", PORTS_O_X, tick_read<Policy>}
+       : c == 'P' ? OperatorDef{"push", PORTS_P, tick_push<Policy>}
+       : c == 'Q' ? OperatorDef{"query", PORTS_G_Q, tick_query<Policy>}
+       : c == 'R' ? OperatorDef{"random", PORTS_R, tick_random<Policy>}
+       : c == 'S' ? OperatorDef{"south", PORTS_NONE, tick_south<Policy>}
+       : c == 'T' ? OperatorDef{"track", PORTS_T, tick_track<Policy>}
+       : c == 'U' ? OperatorDef{"uclid", PORTS_NONE, nullptr}
+       : c == 'V' ? OperatorDef{"variable", PORTS_V, tick_variable<Policy>}
+       : c == 'W' ? OperatorDef{"west", PORTS_NONE, tick_west<Policy>}
+       : c == 'X' ? OperatorDef{"write", PORTS_O_X, tick_write<Policy>}
+       : c == 'Y' ? OperatorDef{"jymper", PORTS_J_Y, tick_jymper<Policy>}
+       : c == 'Z' ? OperatorDef{"lerp", PORTS_Z, tick_lerp<Policy>}
+       : c == '*' ? OperatorDef{"bang", PORTS_NONE, tick_bang<Policy>}
+       : c == '#' ? OperatorDef{"comment", PORTS_NONE, tick_comment<Policy>}
+       : c == ':' ? OperatorDef{"midi", PORTS_NOTE, tick_midi<Policy>}
+       : c == '%' ? OperatorDef{"mono", PORTS_NOTE, tick_mono<Policy>}
+       : c == '!' ? OperatorDef{"cc", PORTS_NONE, nullptr}
+       : c == '?' ? OperatorDef{"pb", PORTS_NONE, nullptr}
+       : c == ';' ? OperatorDef{"udp", PORTS_NONE, nullptr}
+       : c == '=' ? OperatorDef{"osc", PORTS_NONE, nullptr}
+       : c == '$' ? OperatorDef{"self", PORTS_NONE, nullptr}
+       : OperatorDef{nullptr, PORTS_NONE, nullptr};
+  // clang-format on
+}
 
-      write_locked(x, y + 1, int_to_b36(res, isupper(modc)), "C-output");
-    }
-    break;
-  }
-  case 'D': {
-    char ratec = read_cell(x - 1, y, "D-rate");
-    char modc = read_locked(x + 1, y, "D-mod");
-
-    int rate = b36_to_int(ratec, 1);
-    int mod = b36_to_int(modc, 8);
-
-    if (rate < 1)
-      rate = 1;
-
-    bool bang = mod != 0 && (mod == 1 || (ticks % (rate * mod) == 0));
-    write_locked(x, y + 1, (bang ? '*' : '.'), "D-output");
-    break;
-  }
-  case 'E':
-    move_operation(x, y, 1, 0);
-    break;
-  case 'F': {
-    char ca = read_cell(x - 1, y, "F-a");
-    char cb = read_locked(x + 1, y, "F-b");
-    write_locked(x, y + 1, ca == cb ? '*' : '.', "F-output");
-    break;
-  }
-  case 'G': {
-    char cx = read_cell(x - 3, y, "G-x");
-    char cy = read_cell(x - 2, y, "G-y");
-    char clen = read_cell(x - 1, y, "G-len");
-
-    int x_ = b36_to_int(cx, 0);
-    int y_ = b36_to_int(cy, 0);
-    int len = b36_to_int(clen, 1);
-
-    if (len < 1)
-      len = 1;
-
-    static const char *in_descs[] = {
-        "G-in0", "G-in1", "G-in2", "G-in3", "G-in4", "G-in5", "G-in6", "G-in7",
-        "G-in8", "G-in9", "G-inA", "G-inB", "G-inC", "G-inD", "G-inE", "G-inF",
-        "G-inG", "G-inH", "G-inI", "G-inJ", "G-inK", "G-inL", "G-inM", "G-inN",
-        "G-inO", "G-inP", "G-inQ", "G-inR", "G-inS", "G-inT", "G-inU", "G-inV",
-        "G-inW", "G-inX", "G-inY", "G-inZ",
-    };
-
-    static const char *out_descs[] = {
-        "G-out0", "G-out1", "G-out2", "G-out3", "G-out4", "G-out5",
-        "G-out6", "G-out7", "G-out8", "G-out9", "G-outA", "G-outB",
-        "G-outC", "G-outD", "G-outE", "G-outF", "G-outG", "G-outH",
-        "G-outI", "G-outJ", "G-outK", "G-outL", "G-outM", "G-outN",
-        "G-outO", "G-outP", "G-outQ", "G-outR", "G-outS", "G-outT",
-        "G-outU", "G-outV", "G-outW", "G-outX", "G-outY", "G-outZ",
-    };
-
-    for (int i = 0; i < len; ++i) {
-      write_locked(x + x_ + i, y + y_ + 1,
-                   read_locked(x + 1 + i, y, in_descs[i]), out_descs[i]);
+// Indexed by the effective glyph, a tick is a single indirect call.
+template <typename Policy> struct Operators {
+  static constexpr OperatorDef table[256] = {LUT_256(operator_def<Policy>)};
+};
+
+template <typename Policy>
+constexpr OperatorDef Operators<Policy>::table[256];
+
+std::string Machine::describe(int x, int y) const {
+  if (!is_valid(x, y))
+    return "empty";
+
+  auto i = cell_index(x, y);
+  if ((flags_at(i) & CF_HAS_DESC) == 0)
+    return "empty";
+
+  auto desc = desc_at(i);
+  char op = desc >> 8;
+  int port = desc & 0xff;
+
+  auto &def = Operators<AnnotatedTick>::table[(unsigned char)op];
+  if (!def.name)
+    return "empty";
+
+  if (port == 0)
+    return def.name;
+
+  int first = 1;
+  for (auto port_name = def.ports; *port_name; ++port_name) {
+    std::string out = std::string(1, op) + "-" + *port_name;
+
+    if (out.back() != '*') {
+      if (port == first)
+        return out;
+      first++;
+    } else {
+      if (port < first + 36) {
+        out.back() = int_to_b36(port - first, true);
+        return out;
+      }
+      first += 36;
     }
+  }
+
+  return "empty";
+}
 
-    break;
+// The playing notes, in start order, with what is left of them.
+static uint64_t notes_hash(const NoteSchedule &notes) {
+  uint64_t hash = 0;
+  for (auto i = notes.order.head; i != NoteSchedule::NIL;
+       i = notes.slots[i].order.next) {
+    auto note = notes.remaining(i);
+    uint32_t velocity;
+    memcpy(&velocity, &note.velocity, sizeof velocity);
+
+    hash = zobrist_key(hash ^ (uint64_t)velocity << 32 ^
+                       (uint64_t)note.channel << 24 ^
+                       (uint64_t)note.key << 16 ^ (uint16_t)note.length);
   }
-  case 'H': {
-    lock_cell(x, y + 1);
-    break;
+  return hash;
+}
+
+template <typename Policy> void Machine::tick() {
+  if (find_cycles)
+    cycles.check(state_hash());
+
+  if (track_changes) {
+    changes.clear();
+    changes.reset = shadows.empty();
+    shadows.resize(tile_store.size());
+  } else {
+    shadows.clear();
   }
-  case 'I': {
-    char stepc = read_cell(x - 1, y, "I-step");
-    char modc = read_locked(x + 1, y, "I-mod");
 
-    int step = b36_to_int(stepc, 1);
-    int mod = b36_to_int(modc, 10);
+  clock_period = 1;
+  settle_tiles(Policy::annotate);
+  prepare_cells(*this);
+  collect_old_notes(*this);
 
-    if (mod < 1)
-      mod = 10;
+  if (!pool || !tick_regions<Policy>())
+    tick_serial<Policy>();
 
-    char resc = peek_cell(x, y + 1);
-    int res = b36_to_int(resc, 0);
+  if (track_changes) {
+    shadows.resize(tile_store.size());
+    for (auto slot : live_tiles)
+      report_tile(slot);
+  }
 
-    res = (res + step) % mod;
-
-    write_locked(x, y + 1, int_to_b36(res, isupper(modc)), "I-output");
-    break;
-  }
-  case 'J': {
-    write_locked(x, y + 1, read_cell(x, y - 1, "J-input"), "J-output");
-    break;
-  }
-  case 'K': {
-    char clen = read_cell(x - 1, y, "K-len");
-    int len = b36_to_int(clen, 1);
-
-    if (len < 1)
-      len = 1;
-
-    static const char *in_descs[] = {
-        "K-read0", "K-read1", "K-read2", "K-read3", "K-read4", "K-read5",
-        "K-read6", "K-read7", "K-read8", "K-read9", "K-readA", "K-readB",
-        "K-readC", "K-readD", "K-readE", "K-readF", "K-readG", "K-readH",
-        "K-readI", "K-readJ", "K-readK", "K-readL", "K-readM", "K-readN",
-        "K-readO", "K-readP", "K-readQ", "K-readR", "K-readS", "K-readT",
-        "K-readU", "K-readV", "K-readW", "K-readX", "K-readY", "K-readZ",
-    };
-
-    static const char *out_descs[] = {
-        "K-out0", "K-out1", "K-out2", "K-out3", "K-out4", "K-out5",
-        "K-out6", "K-out7", "K-out8", "K-out9", "K-outA", "K-outB",
-        "K-outC", "K-outD", "K-outE", "K-outF", "K-outG", "K-outH",
-        "K-outI", "K-outJ", "K-outK", "K-outL", "K-outM", "K-outN",
-        "K-outO", "K-outP", "K-outQ", "K-outR", "K-outS", "K-outT",
-        "K-outU", "K-outV", "K-outW", "K-outX", "K-outY", "K-outZ",
-    };
-
-    for (int i = 0; i < len; ++i) {
-      char varc = read_locked(x + 1 + i, y, in_descs[i]);
-      if (varc == '.')
-        write_locked(x + 1 + i, y + 1, '.', out_descs[i]);
-      else
-        write_locked(x + 1 + i, y + 1, variables[varc], out_descs[i]);
-    }
-    break;
-  }
-  case 'L': {
-    char ca = read_cell(x - 1, y, "L-a");
-    char cb = read_locked(x + 1, y, "L-b");
-
-    char res = tolower(ca) < tolower(cb) ? ca : cb;
-
-    write_locked(x, y + 1, isupper(cb) ? toupper(res) : tolower(res),
-                 "L-output");
-    break;
-  }
-  case 'M': {
-    char ca = read_cell(x - 1, y, "M-a");
-    char cb = read_locked(x + 1, y, "M-b");
-    int a = b36_to_int(ca, 0);
-    int b = b36_to_int(cb, 0);
-    write_locked(x, y + 1, int_to_b36(a * b, isupper(cb)), "M-output");
-    break;
-  }
-  case 'N':
-    move_operation(x, y, 0, -1);
-    break;
-
-  case 'O': {
-    char cx = read_cell(x - 2, y, "O-x");
-    char cy = read_cell(x - 1, y, "O-y");
-
-    int x_ = b36_to_int(cx, 0);
-    int y_ = b36_to_int(cy, 0);
-
-    write_locked(x, y + 1, read_locked(x + 1 + x_, y + y_, "O-read"),
-                 "O-output");
-    break;
-  }
-  case 'P': {
-    char ckey = read_cell(x - 2, y, "P-key");
-    char clen = read_cell(x - 1, y, "P-len");
-    char cread = read_locked(x + 1, y, "P-read");
-
-    int key = b36_to_int(ckey, 0);
-    int len = b36_to_int(clen, 0);
-
-    if (len < 1)
-      len = 1;
-
-    key %= len;
-
-    for (int i = 0; i < len; ++i)
-      lock_cell(x + i, y + 1);
-
-    write_locked(x + key, y + 1, cread, "P-output");
-    break;
-  }
-  case 'Q': {
-    char cx = read_cell(x - 3, y, "Q-x");
-    char cy = read_cell(x - 2, y, "Q-y");
-    char clen = read_cell(x - 1, y, "Q-len");
-
-    int x_ = b36_to_int(cx, 0);
-    int y_ = b36_to_int(cy, 0);
-    int len = b36_to_int(clen, 1);
-
-    if (len < 1)
-      len = 1;
-
-    static const char *in_descs[] = {
-        "Q-in0", "Q-in1", "Q-in2", "Q-in3", "Q-in4", "Q-in5", "Q-in6", "Q-in7",
-        "Q-in8", "Q-in9", "Q-inA", "Q-inB", "Q-inC", "Q-inD", "Q-inE", "Q-inF",
-        "Q-inG", "Q-inH", "Q-inI", "Q-inJ", "Q-inK", "Q-inL", "Q-inM", "Q-inN",
-        "Q-inO", "Q-inP", "Q-inQ", "Q-inR", "Q-inS", "Q-inT", "Q-inU", "Q-inV",
-        "Q-inW", "Q-inX", "Q-inY", "Q-inZ",
-    };
-
-    static const char *out_descs[] = {
-        "Q-out0", "Q-out1", "Q-out2", "Q-out3", "Q-out4", "Q-out5",
-        "Q-out6", "Q-out7", "Q-out8", "Q-out9", "Q-outA", "Q-outB",
-        "Q-outC", "Q-outD", "Q-outE", "Q-outF", "Q-outG", "Q-outH",
-        "Q-outI", "Q-outJ", "Q-outK", "Q-outL", "Q-outM", "Q-outN",
-        "Q-outO", "Q-outP", "Q-outQ", "Q-outR", "Q-outS", "Q-outT",
-        "Q-outU", "Q-outV", "Q-outW", "Q-outX", "Q-outY", "Q-outZ",
-    };
-
-    for (int i = 0; i < len; ++i) {
-      write_locked(x + i - len + 1, y + 1,
-                   read_locked(x + x_ + i + 1, y + y_, in_descs[i]),
-                   out_descs[i]);
+  ticks++;
+
+  if (find_cycles)
+    cycles.record(ticks, state_hash(), notes_hash(notes), clock_period);
+}
+
+template <typename Policy> void Machine::tick_serial() {
+  int x = 0, y = 0;
+
+  if (plan_valid) {
+    for (auto &op : plan) {
+      scan_x = op.x;
+      scan_y = op.y;
+      scan_cell<Policy>(op.x, op.y, tile_store[op.tile], op.offset);
+
+      if (!plan_valid) {
+        // stale past this operator, finish like below
+        x = op.x + 1;
+        y = op.y;
+        break;
+      }
     }
-    break;
+
+    if (plan_valid)
+      return;
+  } else {
+    plan.clear();
+    plan_valid = true;
+  }
+
+  // Operators may create or remove other operators while ticking, next_op()
+  // reads the live index so cells ahead of x, y are seen in their current
+  // state, exactly like a row-major scan of the grid would. The plan is
+  // recorded along, it is only kept when nothing did.
+  bool record = x == 0 && y == 0;
+  for (; next_op(x, y); ++x) {
+    auto i = cell_index(x, y);
+    if (record)
+      plan.push_back({x, y, tile_ids[tile_slot(i)], (uint32_t)tile_offset(i)});
+    scan_x = x;
+    scan_y = y;
+    scan_cell<Policy>(x, y);
   }
-  case 'R': {
-    char cmin = read_cell(x - 1, y, "R-min");
-    char cmax = read_locked(x + 1, y, "R-max");
+}
+
+template <typename Policy> void Machine::scan_cell(int x, int y) {
+  // operators are always in allocated tiles
+  auto i = cell_index(x, y);
+  scan_cell<Policy>(x, y, own_tile(i), tile_offset(i));
+}
+
+template <typename Policy>
+void Machine::scan_cell(int x, int y, Tile &t, size_t offset) {
+  auto c = t.glyphs[offset];
+  auto f = t.flags[offset];
+
+  if (f & CF_WAS_TICKED)
+    return;
+
+  auto tick_char = c;
 
-    int min_ = b36_to_int(cmin, 0);
-    int max_ = b36_to_int(cmax, 35);
+  if (f & CF_WAS_BANGED) {
+    tick_char = c.as_upper();
 
-    int res = min_ + (random() / (float)RAND_MAX) * (max_ - min_ + 1);
-    write_locked(x, y + 1, int_to_b36(res, isupper(cmax)), "R-output");
-    break;
+    // lowercase operators are left out of the reach of their tile
+    if (tick_char != c)
+      reach_op<Policy>(tick_char, x, y);
   }
-  case 'S':
-    move_operation(x, y, 0, 1);
-    break;
 
-  case 'T': {
-    char ckey = read_cell(x - 2, y, "T-key");
-    char clen = read_cell(x - 1, y, "T-len");
+  if (is_lower_ch(tick_char) || ((f & CF_IS_LITERAL) && tick_char != '*'))
+    return;
+
+  annotate<Policy>(t, cell_index(x, y), cell_desc(tick_char, 0), 0);
+
+  tick_cell<Policy>(tick_char, x, y);
+}
+
+template <typename Policy>
+void Machine::tick_cell(char effective_c, int x, int y) {
+  auto self = cell_index(x, y);
+  auto &f = flags_at(self);
+
+  if (f & CF_WAS_TICKED)
+    return;
+
+  if (Policy::isolated && !region_allows(effective_c, x, y))
+    return;
+
+  f |= CF_WAS_TICKED;
+
+  auto tick = Operators<Policy>::table[(unsigned char)effective_c].tick;
+  if (tick)
+    tick(*this, x, y);
+}
+
+// The cells an operator may touch when it ticks, relative to its own, and
+// whether it uses the variables or the random numbers of the machine. '#'
+// reaches up to the next '#' of its row instead. Stateful operators depend on
+// more than the cells they reach or change them every time they tick.
+struct Footprint {
+  int left;
+  int right;
+  int up;
+  int down;
+  bool shared;
+  bool stateful;
+};
+
+static constexpr Footprint footprint_of(int c) {
+  // clang-format off
+  return c == 'A' || c == 'B' || c == 'F' || c == 'L' || c == 'M'
+                  ? Footprint{1, 1, 0, 1, false, false}
+       : c == 'C' || c == 'D' || c == 'I' || c == 'Z'
+                  ? Footprint{1, 1, 0, 1, false, true}
+       : c == 'R' || c == 'V'
+                  ? Footprint{1, 1, 0, 1, true, true}
+       : c == 'E' || c == 'N' || c == 'S' || c == 'W' || c == '*'
+                  ? Footprint{1, 1, 1, 1, false, true}
+       : c == 'G' ? Footprint{3, 69, 0, 36, false, false}
+       : c == 'H' ? Footprint{0, 0, 0, 1, false, false}
+       : c == 'J' ? Footprint{0, 0, 1, 1, false, false}
+       : c == 'K' ? Footprint{1, 35, 0, 1, true, true}
+       : c == 'O' ? Footprint{2, 36, 0, 35, false, false}
+       : c == 'P' ? Footprint{2, 34, 0, 1, false, false}
+       : c == 'Q' ? Footprint{34, 70, 0, 35, false, false}
+       : c == 'T' ? Footprint{2, 35, 0, 1, false, false}
+       : c == 'X' ? Footprint{2, 35, 0, 36, false, false}
+       : c == 'Y' ? Footprint{1, 1, 0, 0, false, false}
+       : c == ':' || c == '%'
+                  ? Footprint{0, 5, 0, 0, false, false}
+       : Footprint{0, 0, 0, 0, false, false};
+  // clang-format on
+}
+
+static constexpr Footprint FOOTPRINTS[256] = {LUT_256(footprint_of)};
+
+// Calls f with the slot of every tile overlapping cells x0, y0 to x1, y1,
+// leaving out what is past the guard tiles.
+template <typename F>
+static void for_each_tile(const Machine &m, int x0, int y0, int x1, int y1,
+                          F f) {
+  const int margin = Machine::GUARD_TILES * TILE;
+  x0 = std::max(x0, -margin) >> TILE_SHIFT;
+  y0 = std::max(y0, -margin) >> TILE_SHIFT;
+  x1 = std::min(x1, m.tile_cols * TILE + margin - 1) >> TILE_SHIFT;
+  y1 = std::min(y1, m.tile_rows * TILE + margin - 1) >> TILE_SHIFT;
+
+  for (int ty = y0; ty <= y1; ++ty)
+    for (int tx = x0; tx <= x1; ++tx)
+      f((size_t)(ty + Machine::GUARD_TILES) * m.tiles_w + tx +
+        Machine::GUARD_TILES);
+}
+
+// The cells the operator at x, y may touch ticking as effective_c, and a cell
+// more around for the '*' it may write.
+static CellBox op_reach(const Machine &m, char effective_c, int x, int y) {
+  auto &fp = FOOTPRINTS[(unsigned char)effective_c];
+
+  int right = x + fp.right;
+  if (effective_c == '#')
+    while (right + 1 < m.grid_w() && m.peek_cell(++right, y) != '#')
+      ;
+
+  CellBox box;
+  box.x0 = x - fp.left - 1;
+  box.y0 = y - fp.up - 1;
+  box.x1 = right + 1;
+  box.y1 = y + fp.down + 1;
+  return box;
+}
 
-    int key = b36_to_int(ckey, 0);
-    int len = b36_to_int(clen, 0);
+// Updates the reach of a tile from its operators. Lowercase ones are left
+// out, they only tick when banged and tick_bang() checks what they reach then.
+void Machine::update_reach(size_t slot) {
+  auto &t = tile_store[tile_ids[slot]];
+  auto x0 = ((int)(slot % tiles_w) - GUARD_TILES) * TILE;
+  auto y0 = ((int)(slot / tiles_w) - GUARD_TILES) * TILE;
 
-    if (len < 1)
-      len = 1;
+  t.reach.x0 = t.reach.y0 = INT32_MAX;
+  t.reach.x1 = t.reach.y1 = INT32_MIN;
+  t.reach_stale = t.comments = t.shared = t.stateful = false;
 
-    key %= len;
+  for (int row = 0; row < TILE; ++row) {
+    for (auto bits = t.op_rows[row]; bits; bits &= bits - 1) {
+      int x = x0 + count_trailing_zeros(bits);
+      int y = y0 + row;
 
-    char cval = read_locked(x + 1 + key, y, "T-val");
+      char c = t.glyphs[(row << TILE_SHIFT) + x - x0];
+      if (is_lower_ch(c))
+        continue;
 
-    for (int i = 0; i < len; ++i)
-      lock_cell(x + 1 + i, y);
+      auto &fp = FOOTPRINTS[(unsigned char)c];
+      auto box = op_reach(*this, c, x, y);
 
-    write_locked(x, y + 1, cval, "T-output");
-    break;
+      t.reach.x0 = std::min(t.reach.x0, box.x0);
+      t.reach.y0 = std::min(t.reach.y0, box.y0);
+      t.reach.x1 = std::max(t.reach.x1, box.x1);
+      t.reach.y1 = std::max(t.reach.y1, box.y1);
+      t.comments |= c == '#';
+      t.shared |= fp.shared;
+      t.stateful |= fp.stateful;
+    }
   }
-  case 'U': /* who the fuck knows? */
-    break;
-  case 'V': {
-    char cwrite = read_cell(x - 1, y, "V-write");
-    char cread = read_locked(x + 1, y, "V-read");
+}
 
-    if (cwrite != '.')
-      variables[cwrite] = cread;
-    else if (cread != '.')
-      write_locked(x, y + 1, variables[cread], "V-output");
-    break;
+// Finds the tiles the tick can leave alone. A tile is isolated when no
+// operator of another tile can reach it and its own operators stay inside of
+// it. One that was already isolated during the last tick, that nothing
+// changed in since that tick began and that only holds operators computing
+// their outputs from their cells is quiet: ticking it again would do what the
+// last tick did, so it keeps the flags that tick left, which mark its
+// operators as ticked or locked, and the scan skips over them.
+//
+// Operators written during the tick and then banged, and comments whose end
+// was overwritten, may reach further than their tiles foresaw. tick_bang()
+// and tick_comment() check with reach_op() and reach_into(), which wake the
+// quiet tiles they reach.
+void Machine::settle_tiles(bool annotate) {
+  // flags are annotated or not
+  bool same_policy = annotate == settled_annotate;
+  settled_annotate = annotate;
+
+  for (auto slot : live_tiles) {
+    auto &t = tile_store[tile_ids[slot]];
+    if (!t.ops)
+      continue;
+
+    if (t.reach_stale || t.comments)
+      update_reach(slot);
+
+    // how many other tiles reach each tile
+    for_each_tile(*this, t.reach.x0, t.reach.y0, t.reach.x1, t.reach.y1,
+                  [&](size_t tile) { reach_count[tile] += tile != slot; });
   }
-  case 'W':
-    move_operation(x, y, -1, 0);
-    break;
-  case 'X': {
-    char cx = read_cell(x - 2, y, "X-x");
-    char cy = read_cell(x - 1, y, "X-y");
 
-    int x_ = b36_to_int(cx, 0);
-    int y_ = b36_to_int(cy, 0);
+  isolated_tiles = quiet_tiles = 0;
+  for (auto slot : live_tiles) {
+    auto &t = tile_store[tile_ids[slot]];
+    bool was_isolated = t.isolated;
+    t.isolated = t.quiet = false;
+
+    if (t.ops) {
+      auto x0 = ((int)(slot % tiles_w) - GUARD_TILES) * TILE;
+      auto y0 = ((int)(slot / tiles_w) - GUARD_TILES) * TILE;
+
+      t.isolated = reach_count[slot] == 0 && t.reach.x0 >= x0 &&
+                   t.reach.y0 >= y0 && t.reach.x1 < x0 + TILE &&
+                   t.reach.y1 < y0 + TILE;
+      t.quiet = t.isolated && was_isolated && same_policy && !t.edited &&
+                !t.stateful;
+    }
 
-    write_locked(x + x_, y + y_ + 1, read_locked(x + 1, y, "X-read"),
-                 "X-output");
-    break;
+    t.edited = false;
+    isolated_tiles += t.isolated;
+    quiet_tiles += t.quiet;
   }
-  case 'Y': {
-    write_locked(x + 1, y, read_cell(x - 1, y, "Y-input"), "Y-output");
-    break;
+
+  for (auto slot : live_tiles) {
+    auto &t = tile_store[tile_ids[slot]];
+    if (t.ops)
+      for_each_tile(*this, t.reach.x0, t.reach.y0, t.reach.x1, t.reach.y1,
+                    [&](size_t tile) { reach_count[tile] = 0; });
   }
-  case 'Z': {
-    char ratec = read_cell(x - 1, y, "Z-rate");
-    char targetc = read_locked(x + 1, y, "Z-target");
+}
 
-    int rate = b36_to_int(ratec, 1);
-    int target = b36_to_int(targetc, 0);
+template <typename Policy>
+void Machine::reach_op(char effective_c, int x, int y) {
+  if (!Policy::isolated && isolated_tiles) {
+    auto box = op_reach(*this, effective_c, x, y);
+    reach_into<Policy>(box.x0, box.y0, box.x1, box.y1);
+  }
+}
 
-    char resc = peek_cell(x, y + 1);
-    int res = b36_to_int(resc, 0);
+// Something is about to touch cells x0, y0 to x1, y1 that the tiles holding
+// them did not expect. Parallel ticks check regions instead.
+template <typename Policy>
+void Machine::reach_into(int x0, int y0, int x1, int y1) {
+  if (Policy::isolated || !isolated_tiles)
+    return;
 
-    if (res > target) {
-      res = res - rate;
-      if (res < target)
-        res = target;
-    } else if (res < target) {
-      res = res + rate;
-      if (res > target)
-        res = target;
-    }
-    write_locked(x, y + 1, int_to_b36(res, isupper(target)), "Z-output");
-    break;
+  for_each_tile(*this, x0, y0, x1, y1, [&](size_t slot) {
+    auto &t = tile_store[tile_ids[slot]];
+    if (!t.isolated)
+      return;
+
+    t.isolated = false;
+    isolated_tiles--;
+    if (t.quiet)
+      wake_tile<Policy>(slot);
+  });
+}
+
+// Gives a quiet tile the flags of a tile the scan did not skip: they are
+// reset like at the start of the tick and its operators the scan went past
+// ticked again. Nothing else reached the tile so far, they do what they did.
+template <typename Policy> void Machine::wake_tile(size_t slot) {
+  {
+    auto &t = tile_store[tile_ids[slot]];
+    t.quiet = false;
+    t.edited = true;
+    quiet_tiles--;
+    simd_flag_digits((const char *)t.glyphs, t.flags, TILE_CELLS,
+                     CF_IS_LITERAL);
   }
-  case '*': {
-    if ((cell->flags & CF_IS_LITERAL) == 0)
-      cell->c = '.';
 
-    Cell *neigh;
+  int x0 = ((int)(slot % tiles_w) - GUARD_TILES) * TILE;
+  int y0 = ((int)(slot / tiles_w) - GUARD_TILES) * TILE;
 
-    // XXX: Orca and Orca-c only bang the neighbors to the north and west
-    if ((neigh = get_cell(x, y - 1)) != NULL) {
-      neigh->flags |= CF_WAS_BANGED;
-      tick_cell(neigh->c.as_upper(), x, y - 1, neigh);
-    }
+  for (int y = y0; y < y0 + TILE && y <= scan_y; ++y) {
+    for (int x = x0;; ++x) {
+      // read again after every operator, like next_op()
+      auto bits = tile_store[tile_ids[slot]].op_rows[y - y0] &
+                  (~(uint32_t)0 << (x - x0));
+      if (!bits)
+        break;
+
+      x = x0 + count_trailing_zeros(bits);
+      if (y == scan_y && x >= scan_x)
+        break;
 
-    if ((neigh = get_cell(x - 1, y)) != NULL) {
-      neigh->flags |= CF_WAS_BANGED;
-      tick_cell(neigh->c.as_upper(), x - 1, y, neigh);
+      scan_cell<Policy>(x, y);
     }
+  }
+}
 
-    if ((neigh = get_cell(x, y + 1)) != NULL) {
-      neigh->flags |= CF_WAS_BANGED;
+// Splits the operators into regions: two tiles whose operators have
+// footprints sharing a tile, or that both use shared state, end up in the same
+// one. Returns false when there are less than two.
+bool Machine::split_regions() {
+  region_tiles.clear();
+
+  // union-find over tile slots, tile_region holds the parents for now
+  auto find = [&](int32_t slot) {
+    while (tile_region[slot] != slot) {
+      tile_region[slot] = tile_region[tile_region[slot]];
+      slot = tile_region[slot];
     }
+    return slot;
+  };
+  auto unite = [&](int32_t a, int32_t b) {
+    a = find(a);
+    b = find(b);
+    tile_region[b] = a;
+    return a;
+  };
+
+  int32_t shared = -1;
+
+  for (auto slot : live_tiles) {
+    auto &t = tile_store[tile_ids[slot]];
+    if (!t.ops)
+      continue;
+
+    int32_t root = -1;
+    for_each_tile(*this, t.reach.x0, t.reach.y0, t.reach.x1, t.reach.y1,
+                  [&](size_t tile) {
+                    if (tile_region[tile] < 0) {
+                      tile_region[tile] = tile;
+                      region_tiles.push_back({0, tile});
+                    }
+                    root = root < 0 ? find(tile) : unite(root, tile);
+                  });
+
+    if (t.shared)
+      shared = shared < 0 ? root : unite(shared, root);
+  }
+
+  for (auto &tile : region_tiles)
+    tile.first = find(tile.second);
+  if (shared >= 0)
+    shared = find(shared);
+
+  // regions are runs of tiles with the same root, in slot order
+  std::sort(region_tiles.begin(), region_tiles.end());
 
-    if ((neigh = get_cell(x + 1, y)) != NULL) {
-      neigh->flags |= CF_WAS_BANGED;
+  region_count = 0;
+  for (size_t i = 0; i < region_tiles.size(); ++i) {
+    auto root = region_tiles[i].first;
+
+    if (i == 0 || root != region_tiles[i - 1].first) {
+      if (regions.size() == region_count)
+        regions.emplace_back();
+
+      auto &region = regions[region_count++];
+      region.first = i;
+      region.shared = (int32_t)root == shared;
+      region.escaped = false;
+      region.clock_period = 1;
+      region.notes.clear();
     }
-    break;
+
+    regions[region_count - 1].last = i + 1;
   }
-  case '#':
-    for (int i = x; i < grid_w(); ++i) {
-      auto cell = get_cell(i, y);
-      if (!cell)
-        continue;
-      cell->flags |= CF_IS_LITERAL;
-      if (i > x && cell->c == '#')
+
+  for (size_t r = 0; r < region_count; ++r)
+    for (auto i = regions[r].first; i < regions[r].last; ++i)
+      tile_region[region_tiles[i].second] = r;
+
+  if (region_count < 2) {
+    clear_regions();
+    return false;
+  }
+
+  return true;
+}
+
+void Machine::back_off_regions() {
+  region_backoff = std::min(std::max(2 * region_backoff, 1u), 64u);
+  region_wait = region_backoff;
+}
+
+void Machine::clear_regions() {
+  for (auto &tile : region_tiles)
+    tile_region[tile.second] = -1;
+  region_tiles.clear();
+  region_count = 0;
+}
+
+// Whether the operator at x, y can tick as effective_c without touching
+// another region or the shared state of the machine, marks its region as
+// escaped if not.
+bool Machine::region_allows(char effective_c, int x, int y) {
+  auto id = tile_region[tile_slot(cell_index(x, y))];
+  auto &region = regions[id];
+  auto &fp = FOOTPRINTS[(unsigned char)effective_c];
+
+  if (region.escaped)
+    return false;
+
+  bool inside = region.shared || !fp.shared;
+
+  int right = x + fp.right;
+  if (effective_c == '#') {
+    // only reading the region while looking for the end of the comment
+    while (inside && right + 1 < width) {
+      inside = tile_region[tile_slot(cell_index(++right, y))] == id;
+      if (inside && peek_cell(right, y) == '#')
         break;
     }
-    break;
-  case ':': {
-    char channelc = read_locked(x + 1, y, ":-channel");
-    char octavec = read_locked(x + 2, y, ":-octave");
-    char notec = read_locked(x + 3, y, ":-note");
-    char velocityc = read_locked(x + 4, y, ":-velocity");
-    char lengthc = read_locked(x + 5, y, ":-length");
-
-    int channel = b36_to_int(channelc, 0);
-    int octave = b36_to_int(octavec, 0);
-    int velocity = b36_to_int(velocityc, 15);
-    int length = b36_to_int(lengthc, 1);
-
-    if (cell->flags & CF_WAS_BANGED) {
-      Note n;
-      n.key = note_octave0_to_key(notec, octave);
-      n.channel = channel;
-      n.velocity = std::min(velocity / 16.0f, 16.0f);
-      n.length = length; // length % g
-      notes.push_back(n);
-      // printf(": %c + %i -> %i\n", notec, octave, n.key);
-      tsf_channel_note_on(sf, n.channel, n.key, n.velocity);
-    }
-    break;
-  }
-  case '%': {
-    char channelc = read_locked(x + 1, y, "%-channel");
-    char octavec = read_locked(x + 2, y, "%-octave");
-    char notec = read_locked(x + 3, y, "%-note");
-    char velocityc = read_locked(x + 4, y, "%-velocity");
-    char lengthc = read_locked(x + 5, y, "%-length");
-
-    int channel = b36_to_int(channelc, 0);
-    int octave = b36_to_int(octavec, 0);
-    int velocity = b36_to_int(velocityc, 15);
-    int length = b36_to_int(lengthc, 1);
-
-    if (cell->flags & CF_WAS_BANGED) {
-      Note n;
-      n.key = note_octave0_to_key(notec, octave);
-      n.channel = channel;
-      n.velocity = std::min(velocity / 16.0f, 16.0f);
-      n.length = length; // length % g
-
-      notes.erase(std::remove_if(notes.begin(), notes.end(),
-                                 [&](Note &note) {
-                                   if (n.channel == note.channel)
-                                     tsf_channel_note_off(sf, note.channel,
-                                                          note.key);
-                                   return n.channel == note.channel;
-                                 }),
-                  notes.end());
-
-      notes.push_back(n);
-      // printf("%% %c + %i -> %i\n", notec, octave, n.key);
-      tsf_channel_note_on(sf, n.channel, n.key, n.velocity);
-      tsf_channel_set_pan(sf, n.channel, ticks % 2 == 0);
-    }
-    break;
   }
+
+  if (inside)
+    for_each_tile(*this, x - fp.left, y - fp.up, right, y + fp.down,
+                  [&](size_t tile) { inside &= tile_region[tile] == id; });
+
+  region.escaped = !inside;
+  return inside;
+}
+
+// Ticks the regions on the pool when there are several, returns false when
+// the grid has to be ticked serially instead.
+//
+// A region only holds operators that cannot reach out of it and it is scanned
+// in row-major order, so its cells end up exactly as a serial tick leaves
+// them. Notes are queued and played afterwards in serial order. An operator
+// can still tick somewhere unforeseen, written and then banged or with its
+// '#' gone: the tick is then rolled back from a copy of the region tiles and
+// left to the serial scan.
+//
+// Patches that do not split, or keep escaping, wait longer and longer before
+// the next attempt so they do not pay for it every tick.
+template <typename Policy> bool Machine::tick_regions() {
+  if (pool->size() < 2)
+    return false;
+
+  if (region_wait) {
+    region_wait--;
+    return false;
+  }
+
+  if (!split_regions()) {
+    back_off_regions();
+    return false;
+  }
+
+  // regions cannot allocate tiles while others are reading tile_store
+  region_backup.resize(region_tiles.size());
+  for (size_t i = 0; i < region_tiles.size(); ++i) {
+    auto slot = region_tiles[i].second;
+    if (!tile_ids[slot])
+      alloc_tile(slot);
+    region_backup[i] = tile_store[tile_ids[slot]];
+    // back in once the regions are done, see set_glyph()
+    hash ^= region_backup[i].hash;
+  }
+
+  auto variables_backup = variables;
+  auto rng_backup = rng;
+
+  ticking_regions = true;
+  pool->run(region_count, [this](size_t r) {
+    tick_region<IsolatedTick<Policy>>(regions[r]);
+  });
+  ticking_regions = false;
+
+  bool escaped = false;
+  for (size_t r = 0; r < region_count; ++r)
+    escaped |= regions[r].escaped;
+
+  if (escaped)
+    for (size_t i = 0; i < region_tiles.size(); ++i)
+      tile_store[tile_ids[region_tiles[i].second]] = region_backup[i];
+
+  for (auto &tile : region_tiles)
+    hash ^= tile_store[tile_ids[tile.second]].hash;
+
+  if (escaped) {
+    variables = variables_backup;
+    rng = rng_backup;
+    clear_regions();
+    back_off_regions();
+    return false;
+  }
+
+  for (auto &tile : region_tiles) {
+    auto slot = tile.second;
+    auto tx = (int)(slot % tiles_w) - GUARD_TILES;
+    auto ty = (int)(slot / tiles_w) - GUARD_TILES;
+    if (tx >= 0 && ty >= 0 && tx < tile_cols && ty < tile_rows)
+      mark_op_tile(slot, tile_store[tile_ids[slot]].ops != 0);
+  }
+
+  queued_notes.clear();
+  for (size_t r = 0; r < region_count; ++r) {
+    clock_period = lcm_period(clock_period, regions[r].clock_period);
+    queued_notes.insert(queued_notes.end(), regions[r].notes.begin(),
+                        regions[r].notes.end());
+  }
+
+  std::stable_sort(queued_notes.begin(), queued_notes.end(),
+                   [](const QueuedNote &a, const QueuedNote &b) {
+                     return a.y < b.y || (a.y == b.y && a.x < b.x);
+                   });
+
+  for (auto &queued : queued_notes)
+    play_note(queued.note, queued.mono);
+
+  // regions do not count op_edits
+  plan_valid = false;
+
+  clear_regions();
+  region_backoff = 0;
+  region_ticks++;
+  return true;
+}
+
+template <typename Policy> void Machine::tick_region(TickRegion &region) {
+  // a row of tiles at a time, scanning each cell row across its tiles
+  for (auto first = region.first; first < region.last;) {
+    auto ty = region_tiles[first].second / tiles_w;
+    auto last = first;
+    while (last < region.last && region_tiles[last].second / tiles_w == ty)
+      last++;
+
+    int y0 = ((int)ty - GUARD_TILES) * TILE;
+    for (int y = std::max(y0, 0); y < std::min(y0 + TILE, height); ++y) {
+      for (auto i = first; i < last; ++i) {
+        auto slot = region_tiles[i].second;
+        int x0 = ((int)(slot % tiles_w) - GUARD_TILES) * TILE;
+
+        // read again after every operator, like next_op()
+        auto &ops = tile_store[tile_ids[slot]].op_rows[y & (TILE - 1)];
+        for (int x = 0; x < TILE; ++x) {
+          auto bits = ops & (~(uint32_t)0 << x);
+          if (!bits)
+            break;
+
+          x = count_trailing_zeros(bits);
+          region.scan_x = x0 + x;
+          region.scan_y = y;
+          scan_cell<Policy>(x0 + x, y);
+
+          if (region.escaped)
+            return;
+        }
+      }
+    }
+
+    first = last;
   }
 }
+
+template void Machine::tick<AnnotatedTick>();
+template void Machine::tick<HeadlessTick>();
@@ -1,51 +1,110 @@
 #pragma once
+#include "cycles.hpp"
+#include "notes.hpp"
+#include "soundfont.hpp"
+#include "util.hpp"
 
+#include <array>
 #include <assert.h>
 #include <cctype>
-#include <map>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string>
+#include <utility>
 #include <vector>
 
-static inline bool is_b36(char ch) {
-  return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') ||
-         (ch >= 'A' && ch <= 'Z');
+// Expand to f(0), f(1), ..., f(255), for building lookup tables out of
+// constexpr functions.
+#define LUT_16(f, n)                                                           \
+  f(n + 0), f(n + 1), f(n + 2), f(n + 3), f(n + 4), f(n + 5), f(n + 6),        \
+      f(n + 7), f(n + 8), f(n + 9), f(n + 10), f(n + 11), f(n + 12),           \
+      f(n + 13), f(n + 14), f(n + 15)
+#define LUT_256(f)                                                             \
+  LUT_16(f, 0), LUT_16(f, 16), LUT_16(f, 32), LUT_16(f, 48), LUT_16(f, 64),    \
+      LUT_16(f, 80), LUT_16(f, 96), LUT_16(f, 112), LUT_16(f, 128),            \
+      LUT_16(f, 144), LUT_16(f, 160), LUT_16(f, 176), LUT_16(f, 192),          \
+      LUT_16(f, 208), LUT_16(f, 224), LUT_16(f, 240)
+
+// Per-glyph properties tabulated over all 256 char values, so the tick path
+// classifies and converts glyphs with one load instead of range checks and
+// locale dependent <cctype> calls.
+enum GlyphClass {
+  GC_DIGIT = 1 << 0,
+  GC_LOWER = 1 << 1,
+  GC_UPPER = 1 << 2,
+  GC_OPERATOR = 1 << 3, // letters and the special operator glyphs
+  GC_VALID = 1 << 4,    // may be stored in the grid
+};
+
+struct GlyphInfo {
+  signed char b36; // base 36 value, -1 for anything else
+  unsigned char cls;
+  char upper;
+  char lower;
+};
+
+static constexpr GlyphInfo glyph_info_of(int c) {
+  return c >= '0' && c <= '9'
+             ? GlyphInfo{(signed char)(c - '0'), GC_DIGIT | GC_VALID, (char)c,
+                         (char)c}
+         : c >= 'a' && c <= 'z'
+             ? GlyphInfo{(signed char)(10 + c - 'a'),
+                         GC_LOWER | GC_OPERATOR | GC_VALID,
+                         (char)(c - 'a' + 'A'), (char)c}
+         : c >= 'A' && c <= 'Z'
+             ? GlyphInfo{(signed char)(10 + c - 'A'),
+                         GC_UPPER | GC_OPERATOR | GC_VALID, (char)c,
+                         (char)(c - 'A' + 'a')}
+         : c == '*' || c == '#' || c == ':' || c == '%' || c == '!' ||
+                 c == '?' || c == ';' || c == '=' || c == '$'
+             ? GlyphInfo{-1, GC_OPERATOR | GC_VALID, (char)c, (char)c}
+         : c == '.' ? GlyphInfo{-1, GC_VALID, (char)c, (char)c}
+                    : GlyphInfo{-1, 0, (char)c, (char)c};
 }
 
-static inline char int_to_b36(int v, bool upper) {
-  v %= 36;
-  assert(v >= 0 && v <= 35);
-  if (upper)
-    return "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[v % 36];
+// A class template so the table can live in the header without a definition
+// in every translation unit.
+template <typename T = void> struct GlyphTable {
+  static constexpr GlyphInfo info[256] = {LUT_256(glyph_info_of)};
+};
 
-  return "0123456789abcdefghijklmnopqrstuvwxyz"[v % 36];
+template <typename T> constexpr GlyphInfo GlyphTable<T>::info[256];
+
+static inline const GlyphInfo &glyph_info(char ch) {
+  return GlyphTable<>::info[(unsigned char)ch];
 }
 
-static inline int b36_to_int_raw(char ch) {
-  if (ch >= '0' && ch <= '9')
-    return ch - '0';
+static inline bool is_b36(char ch) { return glyph_info(ch).b36 >= 0; }
 
-  if (ch >= 'a' && ch <= 'z')
-    return 10 + ch - 'a';
+static inline bool is_operator_ch(char ch) {
+  return glyph_info(ch).cls & GC_OPERATOR;
+}
 
-  if (ch >= 'A' && ch <= 'Z')
-    return 10 + ch - 'A';
+static inline bool is_lower_ch(char ch) {
+  return glyph_info(ch).cls & GC_LOWER;
+}
 
-  return -1;
+static inline bool is_upper_ch(char ch) {
+  return glyph_info(ch).cls & GC_UPPER;
 }
 
-static inline int b36_to_int(char ch, int fallback) {
-  if (ch >= '0' && ch <= '9')
-    return ch - '0';
+static inline char to_upper_ch(char ch) { return glyph_info(ch).upper; }
 
-  if (ch >= 'a' && ch <= 'z')
-    return 10 + ch - 'a';
+static inline char to_lower_ch(char ch) { return glyph_info(ch).lower; }
+
+static inline char int_to_b36(int v, bool upper) {
+  v %= 36;
+  assert(v >= 0 && v <= 35);
+  return "0123456789abcdefghijklmnopqrstuvwxyz"
+         "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[upper * 36 + v];
+}
 
-  if (ch >= 'A' && ch <= 'Z')
-    return 10 + ch - 'A';
+static inline int b36_to_int_raw(char ch) { return glyph_info(ch).b36; }
 
-  return fallback;
+static inline int b36_to_int(char ch, int fallback) {
+  int v = glyph_info(ch).b36;
+  return v < 0 ? fallback : v;
 }
 
 static int note_octave0_to_key(char note, int octave0) {
@@ -58,31 +117,26 @@ static int note_octave0_to_key(char note, int octave0) {
   static const int midi_notes[] =  { 9, 11, 0, 2, 4, 5, 7 };
   // clang-format on
 
-  bool sharp = islower(note);
+  auto &info = glyph_info(note);
+  bool sharp = info.cls & GC_LOWER;
 
-  note = toupper(note);
+  note = info.upper;
 
-  if (!isalpha(note))
+  if (!(info.cls & (GC_LOWER | GC_UPPER)))
     return -1;
 
   // Orca's README says:
   // "The midi operator interprets any letter above the chromatic scale as a
   // transpose value, for instance 3H, is equivalent to 4A."
-  // also H -> A, I -> B
-  while (note > 'I') {
-    note -= 'I';
-    octave0++;
-  }
-
-  // map H -> A and I -> B
-  if (note > 'G')
-    note -= 'G';
+  // so every 7 letters go up an octave: H -> A, I -> B and so on up to Z
+  int index = note - 'A';
+  octave0 += index / 7;
 
   // MIDI's first note is C-2, but Orca can't handle n < 0 so
   // we skip the firs two octaves and start at C0.
   int octave = octave0 + 2;
 
-  int out = midi_notes[note - 'A'];
+  int out = midi_notes[index % 7];
   out += octave * 12;
   out += sharp;
 
@@ -97,12 +151,16 @@ enum CellFlags {
   CF_WAS_BANGED = 1 << 3, // something banged this cell
   CF_WAS_READ = 1 << 4,
   CF_WAS_WRITTEN = 1 << 5,
+  CF_HAS_DESC = 1 << 6, // Machine::tile_descs has a descriptor from this tick
 };
 
-static inline bool is_operator_ch(char ch) {
-  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '*' ||
-         ch == '#' || ch == ':' || ch == '%' || ch == '!' || ch == '?' ||
-         ch == ';' || ch == '=' || ch == '$';
+// Identifies the operator port that last touched a cell: the operator glyph
+// goes in the high byte and the port number in the low byte, port 0 being the
+// operator itself. Machine::describe() turns them into text.
+typedef uint16_t CellDesc;
+
+static constexpr CellDesc cell_desc(char op, int port) {
+  return (CellDesc)((unsigned char)op << 8 | port);
 }
 
 struct Cell {
@@ -115,12 +173,19 @@ struct Cell {
 
     Glyph(int c) : ch('.') { operator=(c); }
 
-    Glyph as_upper() const { return Glyph(toupper(ch)); }
-
-    bool valid_c(char c) const {
-      return c == '.' || (c >= '0' && c <= '9') || is_operator_ch(c);
+    // Engine writes only store glyphs read back from the grid or produced by
+    // int_to_b36(), so they skip the validity check in release builds.
+    static Glyph trusted(char c) {
+      assert(glyph_info(c).cls & GC_VALID);
+      Glyph g;
+      g.ch = c;
+      return g;
     }
 
+    Glyph as_upper() const { return trusted(to_upper_ch(ch)); }
+
+    bool valid_c(char c) const { return glyph_info(c).cls & GC_VALID; }
+
     operator char() const { return ch; }
 
     bool operator==(int c) const { return ch == c; }
@@ -138,7 +203,7 @@ struct Cell {
   };
 
   Glyph c = '.';
-  unsigned char flags;
+  unsigned char flags = 0;
 
   int to_int(int fallback) const {
     return is_b36(c) ? b36_to_int_raw(c) : fallback;
@@ -146,141 +211,745 @@ struct Cell {
   void from_int(int v, bool upper) { c = int_to_b36(v, upper); }
 };
 
-struct Note {
-  int channel;
-  int key;
-  float velocity;
-  int length;
+// Zobrist keys, XORed together into Machine::state_hash(). They are mixed
+// out of what they stand for with splitmix64 rather than drawn into a table,
+// which would need one per glyph for every cell. '.' has no key so empty cells
+// and unset variables add nothing.
+static inline uint64_t zobrist_key(uint64_t n) {
+  n += 0x9e3779b97f4a7c15ULL;
+  n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  n = (n ^ (n >> 27)) * 0x94d049bb133111ebULL;
+  return n ^ (n >> 31);
+}
+
+// c at cell index i, see Machine::cell_index()
+static inline uint64_t glyph_key(size_t i, char c) {
+  return c == '.' ? 0 : zobrist_key((uint64_t)i << 8 | (unsigned char)c);
+}
+
+static inline uint64_t variable_key(char name, char value) {
+  return value == '.' ? 0
+                      : zobrist_key(1ULL << 63 | (unsigned char)name << 8 |
+                                    (unsigned char)value);
+}
+
+// Values stored by V, one slot per glyph so lookups never allocate. '.' is the
+// unset value, a read of a variable nobody wrote yields it like it always did.
+struct Variables {
+  std::array<Cell::Glyph, 256> values;
+  uint64_t hash = 0; // keys of the values, kept by set()
+
+  const Cell::Glyph &operator[](char name) const { return at(name); }
+
+  const Cell::Glyph &at(char name) const {
+    return values[(unsigned char)name];
+  }
+
+  void set(char name, Cell::Glyph value) {
+    auto &v = values[(unsigned char)name];
+    hash ^= variable_key(name, v) ^ variable_key(name, value);
+    v = value;
+  }
+
+  void clear() {
+    values.fill(Cell::Glyph());
+    hash = 0;
+  }
 };
 
-struct tsf;
+// The numbers R draws: the additive feedback generator behind glibc's random(),
+// seeded the way srandom() does it, so a new machine yields the sequence a
+// fresh process always did. Each machine owning one keeps machines apart and
+// lets a parallel tick roll back what it drew.
+struct Random {
+  static const int DEGREE = 31;
+  static const int SEPARATION = 3;
+  static const int32_t MAX = 0x7fffffff;
+
+  uint32_t state[DEGREE];
+  int front = SEPARATION;
+  int rear = 0;
+
+  explicit Random(uint32_t seed = 1) { reseed(seed); }
+
+  void reseed(uint32_t seed) {
+    state[0] = seed ? seed : 1;
+    int32_t word = (int32_t)state[0];
+
+    for (int i = 1; i < DEGREE; ++i) {
+      // 16807 * word % 2147483647 without overflowing 32 bits
+      word = (int32_t)(16807 * (int64_t)(word % 127773) -
+                       2836 * (int64_t)(word / 127773));
+      if (word < 0)
+        word += MAX;
+      state[i] = word;
+    }
+
+    front = SEPARATION;
+    rear = 0;
+    for (int i = 0; i < 10 * DEGREE; ++i)
+      next();
+  }
+
+  // 0 to MAX
+  int32_t next() {
+    uint32_t value = state[front] += state[rear];
+    front = (front + 1) % DEGREE;
+    rear = (rear + 1) % DEGREE;
+    return value >> 1;
+  }
+};
+
+// Compile time policies for the tick path. AnnotatedTick keeps the UI
+// bookkeeping System draws from (CF_WAS_READ, CF_WAS_WRITTEN and the cell
+// descriptors), HeadlessTick compiles it out for tests, servers and offline
+// renders. Both produce the same glyphs and notes.
+struct AnnotatedTick {
+  static constexpr bool annotate = true;
+  static constexpr bool isolated = false;
+};
+
+struct HeadlessTick {
+  static constexpr bool annotate = false;
+  static constexpr bool isolated = false;
+};
+
+// Ticks one region of a parallel tick, see Machine::tick_regions(): every
+// operator is checked to stay inside its region before it runs and notes are
+// queued instead of played.
+template <typename Base> struct IsolatedTick : Base {
+  static constexpr bool isolated = true;
+};
+
+// A square block of cells. The grid is made of tiles that are only allocated
+// once something is stored in them, see Machine.
+static const int TILE_SHIFT = 5;
+static const int TILE = 1 << TILE_SHIFT;
+static const int TILE_CELLS = TILE * TILE;
+
+// Cells x0, y0 to x1, y1.
+struct CellBox {
+  int x0 = 0;
+  int y0 = 0;
+  int x1 = -1;
+  int y1 = -1;
+};
+
+struct Tile {
+  Cell::Glyph glyphs[TILE_CELLS];
+  unsigned char flags[TILE_CELLS] = {};
+
+  uint32_t op_rows[TILE] = {}; // bit x of op_rows[y] is set for operators
+  int ops = 0;                 // operator glyphs
+  int filled = 0;              // glyphs other than '.'
+  uint32_t live_pos = 0;       // position in Machine::live_tiles
+  uint64_t hash = 0;           // glyph_key() of the cells, XORed
+
+  // What the operators may touch when they tick, see Machine::update_reach().
+  // Kept until an operator glyph changes, unless a '#' makes it depend on
+  // other tiles.
+  CellBox reach;
+  bool reach_stale = true;
+  bool comments = false;
+  bool shared = false;   // some operator uses the variables or R
+  bool stateful = false; // some operator is not a function of its cells
+
+  // see Machine::settle_tiles()
+  bool edited = true; // a glyph or a flag changed since the last tick began
+  bool isolated = false;
+  bool quiet = false;
+};
+
+// What a tick changed, for consumers mirroring the machine: the cells whose
+// glyph or flags differ from what the previous change set left them at, edits
+// made between ticks included, and the notes that started or ended. The
+// vectors keep their capacity, once they have grown to the busiest tick of a
+// patch filling them allocates nothing.
+struct ChangeSet {
+  struct CellChange {
+    int x;
+    int y;
+    Cell::Glyph c;
+    unsigned char flags;
+  };
+
+  struct NoteEvent {
+    Note note;
+    bool on;
+  };
+
+  // Set on the first tracked tick and after the grid was resized or loaded:
+  // cells then lists every cell that is not empty, apply it to an empty grid
+  // of the current size.
+  bool reset = false;
+  std::vector<CellChange> cells;
+  std::vector<NoteEvent> notes;
+
+  void clear() {
+    reset = false;
+    cells.clear();
+    notes.clear();
+  }
+};
+
+// A tile as the last change set reported it.
+struct TileShadow {
+  Cell::Glyph glyphs[TILE_CELLS];
+  unsigned char flags[TILE_CELLS] = {};
+};
+
+// A note played during a parallel tick, in the order the serial scan would
+// have played it: by the position of the operator being scanned, then by when
+// it was queued.
+struct QueuedNote {
+  int y;
+  int x;
+  Note note;
+  bool mono;
+};
+
+// Tiles no operator outside of them can reach, ticked on their own during a
+// parallel tick.
+struct TickRegion {
+  size_t first = 0; // range of Machine::region_tiles
+  size_t last = 0;
+  bool shared = false;  // holds the operators using variables and R
+  bool escaped = false; // an operator would have reached out of the region
+  uint32_t clock_period = 1; // see Machine::clock_period
+  int scan_x = 0;       // operator being scanned
+  int scan_y = 0;
+  std::vector<QueuedNote> notes;
+};
+
+// An operator of the execution plan, see Machine::plan.
+struct PlanOp {
+  int x;
+  int y;
+  uint32_t tile; // id in Machine::tile_store
+  uint32_t offset;
+};
+
+struct ThreadPool;
 struct Machine {
   static const int AUDIO_SAMPLE_RATE = 44100;
   static const int FRAMES_PER_SECOND = 60;
-  static const std::map<char, const char *> OPERATOR_NAMES;
+  static const int AUDIO_SAMPLES = AUDIO_SAMPLE_RATE / FRAMES_PER_SECOND * 2;
 
-  std::array<int16_t, AUDIO_SAMPLE_RATE / FRAMES_PER_SECOND * 2> audio_samples;
+  // The audio of the last run(), interleaved stereo as the synth renders it.
+  // Frontends that take float play it as is, audio_samples_s16() converts
+  // it for the others.
+  std::array<float, AUDIO_SAMPLES> audio_samples;
   size_t audio_sample_count = 0;
 
-  std::vector<std::vector<Cell>> cells;
-  std::vector<std::vector<const char *>> cell_descs;
-  std::vector<Note> notes;
-
-  tsf *sf = nullptr;
-
-  std::map<Cell::Glyph, Cell::Glyph> variables;
+  // The grid is stored in tiles of TILE x TILE cells. tile_ids maps every
+  // tile position to its tile in tile_store, 0 being a shared empty tile that
+  // is never written: reading empty space costs no memory, the first write or
+  // flag change allocates a tile and tiles that are empty again at the start
+  // of a tick after being left alone for one go back to free_tiles. Memory
+  // and tick time follow the occupied area, not the canvas size.
+  //
+  // GUARD_TILES of tiles surround the grid, so reads up to GUARD cells away
+  // from it need no bounds check, they land in tiles that always hold '.'.
+  // Writes and moves check is_valid() so no glyph is ever stored there. Reads
+  // may leave flags in them, prepare_cells() frees them again at the start of
+  // the next tick whatever their flags.
+  //
+  // Cell (x, y) has index (slot << 2 * TILE_SHIFT) + its offset in the tile,
+  // slot being the position of its tile in tile_ids.
+  static const int GUARD = 36; // farthest operand of G, K, O, P and T
+  static const int GUARD_TILES = (GUARD + TILE - 1) / TILE;
+  int width = 0;
+  int height = 0;
+  int tile_cols = 0; // tiles covering the grid, without guard tiles
+  int tile_rows = 0;
+  int tiles_w = 0; // tile_ids is tiles_w wide, guard tiles included
+  std::vector<uint32_t> tile_ids;
+  std::vector<Tile> tile_store;
+  std::vector<uint32_t> free_tiles;
+  std::vector<uint32_t> live_tiles; // slots of the allocated tiles
+
+  // The descriptors of the cells of each tile in tile_store, by tile id.
+  // Allocated on the first annotated tick touching the tile, machines that
+  // never annotate keep them all empty.
+  std::vector<std::vector<CellDesc>> tile_descs;
+
+  // One bit per tile column for each tile row, set for the tiles holding
+  // operators, so tick() skips empty tiles wholesale and only scans the
+  // op_rows of the others. Glyph writes must go through set_glyph() to keep
+  // it up to date.
+  std::vector<uint64_t> op_tiles;
+  int op_tile_words = 0;
+
+  // With track_changes set, tick() fills changes, see ChangeSet. shadows[id]
+  // is what was last reported for tile_store[id], it is empty until the first
+  // tracked tick and after set_size(), which makes the next one a reset.
+  bool track_changes = false;
+  ChangeSet changes;
+  std::vector<TileShadow> shadows;
+
+  // When set, tick() splits the grid into regions operators cannot reach
+  // across and ticks them on the pool, see tick_regions(). tile_region maps
+  // tile slots to their region, -1 outside of every region.
+  ThreadPool *pool = nullptr;
+  std::vector<int32_t> tile_region;
+  std::vector<std::pair<uint32_t, uint32_t>> region_tiles; // region, slot
+  std::vector<TickRegion> regions;
+  size_t region_count = 0;
+  std::vector<Tile> region_backup;
+  std::vector<QueuedNote> queued_notes;
+  bool ticking_regions = false;
+  unsigned region_ticks = 0; // ticks that did run on regions
+  unsigned region_backoff = 0; // ticks to wait after a failed split, doubling
+  unsigned region_wait = 0;
+
+  // The operators of the grid in row-major order, as the last serial tick
+  // found them. Most patches keep the same operator cells for thousands of
+  // ticks: until a cell becomes or stops being an operator, through an edit, a
+  // mover or an operator write, ticks walk the plan instead of searching the
+  // tiles. set_glyph() clears plan_valid when that happens.
+  std::vector<PlanOp> plan;
+  bool plan_valid = false;
+
+  // Tiles the tick leaves alone, see settle_tiles(). reach_count is zero
+  // outside of it.
+  std::vector<uint16_t> reach_count;
+  size_t isolated_tiles = 0;
+  size_t quiet_tiles = 0;
+  bool settled_annotate = false; // policy of the last tick
+  int scan_x = 0;                // operator the serial scan is at
+  int scan_y = 0;
+
+  // Zobrist hash of the glyphs, kept by set_glyph(). Regions only update the
+  // hash of their tiles, tick_regions() folds them in afterwards.
+  uint64_t hash = 0;
+
+  // The tick count modulo clock_period is all the last tick depended on: it is
+  // the lcm of the periods C and D counted, and of the alternating pan of mono
+  // notes. 0 when R drew random numbers, which the hash does not cover, or the
+  // lcm overflowed: the phase is then the tick count itself.
+  uint32_t clock_period = 1;
+
+  // With find_cycles set, tick() looks for the patch becoming periodic so
+  // fast_forward() can skip ahead, see CycleFinder.
+  bool find_cycles = false;
+  CycleFinder cycles;
+
+  NoteSchedule notes;
+
+  // Whether note_on() and note_off() play the notes on the synth, and
+  // whether they queue them in note_events for whoever ticks the machine,
+  // see tick_n().
+  bool synthesize = true;
+  bool queue_notes = false;
+  std::vector<ChangeSet::NoteEvent> note_events;
+
+  SoundFontCopy sf;
+
+  // switch_soundfont() leaves the soundfont to play next in next_sf until the
+  // next tick, and the one it replaced fades out in fading_sf for fade_frames
+  // more sample frames.
+  //
+  // Closing the last copy of a soundfont frees its samples and unmaps its
+  // file, so run() never closes one: those it is done with queue up in
+  // retired_sf, in the order they were retired, for the owner to close on
+  // another thread.
+  static const int SOUNDFONT_FADE = AUDIO_SAMPLE_RATE / 20;
+  SoundFontCopy next_sf;
+  SoundFontCopy fading_sf;
+  std::vector<SoundFontCopy> retired_sf;
+  int fade_frames = 0;
+  std::vector<float> fade_samples;
+
+  Variables variables;
+  Random rng;
 
   int bpm = 120;
 
   unsigned frames = 0;
   unsigned ticks = 0;
 
-  Machine() { sf = nullptr; }
-
-  ~Machine() {
-    // if (sf)
-    // tsf_close(sf);
-  }
+  Machine() {}
 
   bool load_string(const std::string &data);
   std::string to_string() const;
 
+  // Identifies the glyphs, the variables and the clock phase in O(1): equal
+  // states hash the same on any machine of the same size. Notes and the
+  // random number generator are left out.
+  uint64_t state_hash() const {
+    auto phase = clock_period ? ticks % clock_period : ticks;
+    return hash ^ variables.hash ^
+           zobrist_key((uint64_t)clock_period << 32 | phase);
+  }
+
+  // state_hash() from scratch, walking the grid
+  uint64_t full_state_hash() const;
+
+  // makes the last tick depend on the tick count modulo period, see
+  // clock_period
+  void use_clock(int x, int y, uint32_t period);
+
   void init(int width, int height);
   void set_size(int width, int height);
   void reset();
   void run();
 
-  int grid_w() const { return cells[0].size(); }
-  int grid_h() const { return cells.size(); }
+  // Sets up a soundfont copy the way machines play it. It only touches the
+  // copy, so it can run on the thread that loaded it.
+  static void prepare_soundfont(tsf *font);
+
+  // Plays font, set up by prepare_soundfont(), from the next tick on: the
+  // notes playing start over on it and the voices of the current one fade
+  // out over SOUNDFONT_FADE sample frames. Switching never loads anything,
+  // load the soundfont beforehand, off the audio thread.
+  void switch_soundfont(tsf *font) { next_sf = font; }
+  void use_next_soundfont();
+
+  // audio_samples as 16 bit, into out of AUDIO_SAMPLES
+  void audio_samples_s16(int16_t *out) const;
+
+  int grid_w() const { return width; }
+  int grid_h() const { return height; }
+
+  size_t cell_index(int x, int y) const {
+    auto slot = (size_t)((y >> TILE_SHIFT) + GUARD_TILES) * tiles_w +
+                (x >> TILE_SHIFT) + GUARD_TILES;
+    return slot << 2 * TILE_SHIFT | (y & (TILE - 1)) << TILE_SHIFT |
+           (x & (TILE - 1));
+  }
+
+  static size_t tile_slot(size_t i) { return i >> 2 * TILE_SHIFT; }
+
+  bool is_guard_slot(size_t slot) const {
+    int tx = (int)(slot % tiles_w) - GUARD_TILES;
+    int ty = (int)(slot / tiles_w) - GUARD_TILES;
+    return tx < 0 || ty < 0 || tx >= tile_cols || ty >= tile_rows;
+  }
+  static size_t tile_offset(size_t i) { return i & (TILE_CELLS - 1); }
+
+  const Tile &tile(size_t i) const {
+    return tile_store[tile_ids[tile_slot(i)]];
+  }
+
+  // allocates the tile of i if needed
+  Tile &own_tile(size_t i) {
+    auto slot = tile_slot(i);
+    if (!tile_ids[slot])
+      alloc_tile(slot);
+    return tile_store[tile_ids[slot]];
+  }
+
+  void alloc_tile(size_t slot);
+  void free_tile(size_t slot);
+  // adds the cells that differ from the shadow to changes, updating it
+  void report_tile(size_t slot);
+
+  // start and end notes, in the synth and in changes
+  void note_on(const Note &note);
+  void note_off(const Note &note);
+
+  // what : and % do with a note, mono cutting the other notes of its channel
+  void play_note(const Note &note, bool mono);
+  void queue_note(int x, int y, const Note &note, bool mono);
+
+  Cell::Glyph glyph_at(size_t i) const {
+    return tile(i).glyphs[tile_offset(i)];
+  }
+
+  unsigned char flags_at(size_t i) const {
+    return tile(i).flags[tile_offset(i)];
+  }
+
+  // only meaningful if the flags of i have CF_HAS_DESC, 0 for tiles that
+  // were never annotated
+  CellDesc desc_at(size_t i) const {
+    auto &descs = tile_descs[tile_ids[tile_slot(i)]];
+    return descs.empty() ? 0 : descs[tile_offset(i)];
+  }
+
+  unsigned char &flags_at(size_t i) {
+    return own_tile(i).flags[tile_offset(i)];
+  }
+
+  void set_glyph(size_t i, Cell::Glyph c) {
+    if (c == '.' && !tile_ids[tile_slot(i)])
+      return;
+
+    set_glyph(own_tile(i), i, c);
+  }
+
+  // t is the tile of i
+  void set_glyph(Tile &t, size_t i, Cell::Glyph c) {
+    auto &g = t.glyphs[tile_offset(i)];
+    if (g == c)
+      return;
+
+    bool was_op = is_operator_ch(g);
+    bool is_op = is_operator_ch(c);
+
+    auto key = glyph_key(i, g) ^ glyph_key(i, c);
+    t.hash ^= key;
+    if (!ticking_regions)
+      hash ^= key;
+
+    t.filled += (c != '.') - (g != '.');
+    t.edited = true;
+    t.reach_stale |= was_op || is_op;
+    g = c;
+
+    if (was_op != is_op)
+      index_op(t, i, is_op);
+  }
+
+  void index_op(Tile &t, size_t i, bool is_op) {
+    auto offset = tile_offset(i);
+    auto bit = (uint32_t)1 << (offset & (TILE - 1));
+    auto &row = t.op_rows[offset >> TILE_SHIFT];
+
+    // regions tick concurrently, tick_regions() drops the plan instead
+    if (!ticking_regions)
+      plan_valid = false;
+
+    if (is_op) {
+      row |= bit;
+      if (t.ops++)
+        return;
+    } else {
+      row &= ~bit;
+      if (--t.ops)
+        return;
+    }
+
+    // first or last operator of the tile, regions share the words of
+    // op_tiles so tick_regions() updates it once they are done
+    if (!ticking_regions)
+      mark_op_tile(tile_slot(i), is_op);
+  }
+
+  void mark_op_tile(size_t slot, bool has_ops) {
+    auto tx = (int)(slot % tiles_w) - GUARD_TILES;
+    auto ty = (int)(slot / tiles_w) - GUARD_TILES;
+    auto &word = op_tiles[(size_t)ty * op_tile_words + tx / 64];
+    auto tile_bit = (uint64_t)1 << (tx % 64);
+
+    if (has_ops)
+      word |= tile_bit;
+    else
+      word &= ~tile_bit;
+  }
+
+  // Moves x, y to the first operator at or after it in row-major order,
+  // returns false if there is none.
+  bool next_op(int &x, int &y) const {
+    return next_op_in_tile(x, y) || next_op_in_next_tiles(x, y);
+  }
+
+  // most of the time the next operator is in the same tile
+  bool next_op_in_tile(int &x, int &y) const {
+    if (x >= width || y >= height)
+      return false;
+
+    auto bits = tile(cell_index(x, y)).op_rows[y & (TILE - 1)] &
+                (~(uint32_t)0 << (x & (TILE - 1)));
+    if (!bits)
+      return false;
+
+    x = (x & ~(TILE - 1)) + count_trailing_zeros(bits);
+    return true;
+  }
+
+  bool next_op_in_next_tiles(int &x, int &y) const;
 
   Cell new_cell(int x, int y, char ch) {
+    assert(is_valid(x, y));
+
     Cell c;
     c.c = ch;
 
-    cells.at(y).at(x) = c;
+    auto i = cell_index(x, y);
+    set_glyph(i, c.c);
+    own_tile(i).edited = true;
+    flags_at(i) = c.flags;
     return c;
   }
 
+  std::string describe(int x, int y) const;
+
   bool is_valid(int x, int y) const {
     return x >= 0 && y >= 0 && y < grid_h() && x < grid_w();
   }
 
-  /* "private" */
-  void tick();
-  void tick_cell(char effective_c, int x, int y, Cell *cell);
-
-  void move_operation(int x, int y, int X, int Y) {
-    auto cell = &cells[y][x];
-    if (is_valid(x + X, y + Y) && cells[y + Y][x + X].c == '.') {
-      cells[y + Y][x + X] = *cell;
-      cells[y + Y][x + X].flags |= CF_WAS_TICKED;
-      cell->c = '.';
-      cell->flags &= ~CF_WAS_TICKED;
-    } else {
-      cell->c = '*';
-      // cell->flags |= CF_IS_LITERAL;
-    }
+  // whether x, y is in the grid or its border, see GUARD
+  bool in_reach(int x, int y) const {
+    return x >= -GUARD && y >= -GUARD && y < height + GUARD &&
+           x < width + GUARD;
   }
 
-  Cell *get_cell(int x, int y) { return is_valid(x, y) ? &cells[y][x] : NULL; }
+  void tick() { tick<AnnotatedTick>(); }
+  template <typename Policy> void tick();
+
+  // Once find_cycles found the patch periodic, plays the notes of n ticks
+  // without ticking, rounded down to whole periods so the grid ends up as it
+  // is, and calls each_tick() after each one. Returns the ticks played, 0 if
+  // no period is known or the state changed since the last tick. With
+  // track_changes set, changes only holds the notes of each tick.
+  template <typename F> unsigned fast_forward(unsigned n, F each_tick) {
+    auto period = cycles.period;
+    if (!find_cycles || !period || state_hash() != cycles.last_state)
+      return 0;
+
+    n -= n % period;
+    for (unsigned k = 0; k < n; ++k) {
+      if (track_changes)
+        changes.clear();
+
+      notes.advance([&](const Note &note) { note_off(note); });
+      for (auto &played : cycles.back(period - 1 - k % period).played)
+        play_note(played.note, played.mono);
+
+      ticks++;
+      each_tick();
+    }
 
-  char read_locked(int x, int y, const char *desc) {
-    auto cell = get_cell(x, y);
+    cycles.skip(n);
+    return n;
+  }
 
-    if (cell) {
-      cell_descs[y][x] = desc;
-      cell->flags |= CF_WAS_READ;
-      cell->flags |= CF_IS_LITERAL;
-      return cell->c;
+  // Runs n headless ticks without the synth, for analysis: sink(tick, event)
+  // gets the notes each one started and ended, in order, tick being the tick
+  // count after it. Periods find_cycles found are fast-forwarded.
+  template <typename F> void tick_n(unsigned n, F sink) {
+    auto flush = [&] {
+      for (auto &event : note_events)
+        sink(ticks, event);
+      note_events.clear();
+    };
+
+    auto synthesized = synthesize, queued = queue_notes;
+    synthesize = false;
+    queue_notes = true;
+    while (n) {
+      n -= fast_forward(n, flush);
+      if (n) {
+        tick<HeadlessTick>();
+        flush();
+        n--;
+      }
     }
-
-    return '.';
+    synthesize = synthesized;
+    queue_notes = queued;
   }
 
-  void write_locked(int x, int y, Cell::Glyph c, const char *desc) {
-    auto cell = get_cell(x, y);
+  /* "private" */
+  template <typename Policy> void tick_serial();
+  void update_reach(size_t slot);
+  void settle_tiles(bool annotate);
+  template <typename Policy> void reach_op(char effective_c, int x, int y);
+  template <typename Policy> void reach_into(int x0, int y0, int x1, int y1);
+  template <typename Policy> void wake_tile(size_t slot);
+  template <typename Policy> void scan_cell(int x, int y);
+  template <typename Policy> void scan_cell(int x, int y, Tile &t,
+                                            size_t offset);
+  template <typename Policy> void tick_cell(char effective_c, int x, int y);
+
+  template <typename Policy> bool tick_regions();
+  template <typename Policy> void tick_region(TickRegion &region);
+  bool split_regions();
+  void clear_regions();
+  void back_off_regions();
+  bool region_allows(char effective_c, int x, int y);
 
-    if (cell) {
-      cell_descs[y][x] = desc;
-      cell->flags |= CF_WAS_WRITTEN;
-      cell->flags |= CF_IS_LITERAL;
-      cell->c = c;
+  void move_operation(int x, int y, int X, int Y) {
+    auto i = cell_index(x, y);
+    if (is_valid(x + X, y + Y) && glyph_at(cell_index(x + X, y + Y)) == '.') {
+      auto j = cell_index(x + X, y + Y);
+      set_glyph(j, glyph_at(i));
+      // the descriptor stays with the grid, not with the moving operator
+      unsigned char moved = flags_at(i) & ~CF_HAS_DESC;
+      flags_at(j) = moved | (flags_at(j) & CF_HAS_DESC) | CF_WAS_TICKED;
+      set_glyph(i, '.');
+      flags_at(i) &= ~CF_WAS_TICKED;
+    } else {
+      set_glyph(i, '*');
+      // flags[i] |= CF_IS_LITERAL;
     }
   }
 
-  char read_cell(int x, int y, const char *desc) {
-    auto cell = get_cell(x, y);
-    if (cell) {
-      cell_descs[y][x] = desc;
-      cell->flags |= CF_WAS_READ;
+  Cell get_cell(int x, int y) const {
+    Cell c;
+    if (is_valid(x, y)) {
+      auto i = cell_index(x, y);
+      c.c = glyph_at(i);
+      c.flags = flags_at(i);
+    }
+    return c;
+  }
 
-      return cell->c;
+  // i must be in an allocated tile. Only the region owning the tile writes its
+  // descriptors, tile_descs itself is sized by alloc_tile().
+  template <typename Policy>
+  void annotate(Tile &t, size_t i, CellDesc desc, int flag) {
+    if (Policy::annotate) {
+      auto &descs = tile_descs[tile_ids[tile_slot(i)]];
+      if (descs.empty())
+        descs.resize(TILE_CELLS);
+      descs[tile_offset(i)] = desc;
+      t.flags[tile_offset(i)] |= CF_HAS_DESC | flag;
     }
+  }
 
-    return '.';
+  template <typename Policy> void annotate(size_t i, CellDesc desc, int flag) {
+    if (Policy::annotate)
+      annotate<Policy>(own_tile(i), i, desc, flag);
   }
 
-  char peek_cell(int x, int y) {
-    auto cell = get_cell(x, y);
+  template <typename Policy>
+  char read_locked(int x, int y, CellDesc desc) {
+    assert(in_reach(x, y));
+    auto i = cell_index(x, y);
+    auto &t = own_tile(i);
+    auto offset = tile_offset(i);
+    annotate<Policy>(t, i, desc, CF_WAS_READ);
+    t.flags[offset] |= CF_IS_LITERAL;
+    return t.glyphs[offset];
+  }
 
-    if (cell)
-      return cell->c;
+  template <typename Policy>
+  void write_locked(int x, int y, char c, CellDesc desc) {
+    if (is_valid(x, y)) {
+      auto i = cell_index(x, y);
+      auto &t = own_tile(i);
+      auto offset = tile_offset(i);
+      annotate<Policy>(t, i, desc, CF_WAS_WRITTEN);
+      t.flags[offset] |= CF_IS_LITERAL;
+      set_glyph(t, i, Cell::Glyph::trusted(c));
+    }
+  }
+
+  template <typename Policy> char read_cell(int x, int y, CellDesc desc) {
+    assert(in_reach(x, y));
+    auto i = cell_index(x, y);
+    annotate<Policy>(i, desc, CF_WAS_READ);
+    return glyph_at(i);
+  }
 
-    return '.';
+  char peek_cell(int x, int y) const {
+    assert(in_reach(x, y));
+    return glyph_at(cell_index(x, y));
   }
 
   void lock_cell(int x, int y) {
-    auto cell = get_cell(x, y);
-    if (cell)
-      cell->flags |= CF_IS_LITERAL;
+    assert(in_reach(x, y));
+    flags_at(cell_index(x, y)) |= CF_IS_LITERAL;
   }
 
-  void write_cell(int x, int y, char c, const char *desc) {
-    auto cell = get_cell(x, y);
-    if (cell) {
-      cell_descs[y][x] = desc;
-      cell->c = c;
-      cell->flags |= CF_WAS_WRITTEN;
+  template <typename Policy>
+  void write_cell(int x, int y, char c, CellDesc desc) {
+    if (is_valid(x, y)) {
+      auto i = cell_index(x, y);
+      auto &t = own_tile(i);
+      annotate<Policy>(t, i, desc, CF_WAS_WRITTEN);
+      set_glyph(t, i, Cell::Glyph::trusted(c));
     }
   }
 };
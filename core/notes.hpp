@@ -0,0 +1,154 @@
+#pragma once
+#include <array>
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct Note {
+  int channel;
+  int key;
+  float velocity;
+  int length;
+};
+
+// The notes currently playing. They live in a slab of reusable slots and each
+// one sits on three intrusive lists: every note in start order, the timing
+// wheel bucket of the tick it ends on and its channel. Ending a tick's notes
+// and cutting a channel for % only touch the notes involved, and once the slab
+// has grown to the busiest moment of a patch nothing allocates anymore.
+struct NoteSchedule {
+  static const int WHEEL_SIZE = 64; // more than the longest note, 35 ticks
+  static const int CHANNELS = 36;
+  static const int32_t NIL = -1;
+
+  struct Link {
+    int32_t prev = NIL;
+    int32_t next = NIL;
+  };
+
+  struct List {
+    int32_t head = NIL;
+    int32_t tail = NIL;
+  };
+
+  struct Slot {
+    Note note;
+    unsigned start; // value of now when the note started
+    Link order;     // doubles as the free list
+    Link wheel;
+    Link channel;
+  };
+
+  std::vector<Slot> slots;
+  int32_t free_slots = NIL;
+  size_t count = 0;
+  unsigned now = 0;
+
+  List order;
+  std::array<List, WHEEL_SIZE> wheel;
+  std::array<List, CHANNELS> channels;
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+
+  // Oldest playing note, length being what is left of it.
+  Note front() const {
+    assert(!empty());
+    return remaining(order.head);
+  }
+
+  void add(const Note &note) {
+    assert(note.channel >= 0 && note.channel < CHANNELS);
+
+    int32_t i = free_slots;
+    if (i == NIL) {
+      i = (int32_t)slots.size();
+      slots.push_back(Slot());
+    } else {
+      free_slots = slots[i].order.next;
+    }
+
+    slots[i].note = note;
+    slots[i].start = now;
+
+    link(order, &Slot::order, i);
+    link(wheel[end_tick(i) % WHEEL_SIZE], &Slot::wheel, i);
+    link(channels[note.channel], &Slot::channel, i);
+    count++;
+  }
+
+  // Advance one tick and end the notes that run out, in start order. A note
+  // of length n started during tick t ends n ticks later, 1 tick for n = 0.
+  template <typename F> void advance(F note_off) {
+    now++;
+
+    auto &bucket = wheel[now % WHEEL_SIZE];
+    while (bucket.head != NIL) {
+      auto i = bucket.head;
+      note_off(slots[i].note);
+      remove(i);
+    }
+  }
+
+  // End every note playing on channel, in start order.
+  template <typename F> void cut_channel(int channel, F note_off) {
+    assert(channel >= 0 && channel < CHANNELS);
+
+    auto &list = channels[channel];
+    while (list.head != NIL) {
+      auto i = list.head;
+      note_off(slots[i].note);
+      remove(i);
+    }
+  }
+
+  /* "private" */
+  unsigned end_tick(int32_t i) const {
+    auto length = slots[i].note.length;
+    return slots[i].start + (length < 1 ? 1 : length);
+  }
+
+  Note remaining(int32_t i) const {
+    Note note = slots[i].note;
+    note.length -= (int)(now - slots[i].start);
+    return note;
+  }
+
+  void link(List &list, Link Slot::*field, int32_t i) {
+    auto &l = slots[i].*field;
+    l.prev = list.tail;
+    l.next = NIL;
+
+    if (list.tail != NIL)
+      (slots[list.tail].*field).next = i;
+    else
+      list.head = i;
+
+    list.tail = i;
+  }
+
+  void unlink(List &list, Link Slot::*field, int32_t i) {
+    auto &l = slots[i].*field;
+
+    if (l.prev != NIL)
+      (slots[l.prev].*field).next = l.next;
+    else
+      list.head = l.next;
+
+    if (l.next != NIL)
+      (slots[l.next].*field).prev = l.prev;
+    else
+      list.tail = l.prev;
+  }
+
+  void remove(int32_t i) {
+    unlink(order, &Slot::order, i);
+    unlink(wheel[end_tick(i) % WHEEL_SIZE], &Slot::wheel, i);
+    unlink(channels[slots[i].note.channel], &Slot::channel, i);
+
+    slots[i].order.next = free_slots;
+    free_slots = i;
+    count--;
+  }
+};
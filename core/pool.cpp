@@ -0,0 +1,74 @@
+#include "pool.hpp"
+
+ThreadPool::ThreadPool(int threads) {
+  for (int i = 1; i < threads; ++i)
+    workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t)> &f) {
+  if (n == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &f;
+    count = n;
+    next = 0;
+    finished = 0;
+    batch++;
+  }
+  wake.notify_all();
+
+  run_jobs();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return finished == count; });
+  job = nullptr;
+}
+
+void ThreadPool::work() {
+  unsigned seen = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return quit || batch != seen; });
+      if (quit)
+        return;
+      seen = batch;
+    }
+
+    run_jobs();
+  }
+}
+
+void ThreadPool::run_jobs() {
+  for (;;) {
+    const std::function<void(size_t)> *f;
+    size_t i;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!job || next >= count)
+        return;
+      f = job;
+      i = next++;
+    }
+
+    (*f)(i);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (++finished == count)
+      done.notify_all();
+  }
+}
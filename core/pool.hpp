@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for running batches of independent jobs.
+// run() hands the job indices out to the workers and to the calling thread,
+// and returns once all of them are done.
+struct ThreadPool {
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // threads working on a batch, the caller included
+  int size() const { return (int)workers.size() + 1; }
+
+  void run(size_t count, const std::function<void(size_t)> &job);
+
+  /* "private" */
+  void work();
+  void run_jobs();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  const std::function<void(size_t)> *job = nullptr;
+  size_t count = 0;
+  size_t next = 0;
+  size_t finished = 0;
+  unsigned batch = 0;
+  bool quit = false;
+};
@@ -0,0 +1,465 @@
+#include "simd.hpp"
+#include "tsf.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static void flag_digits_scalar(const char *glyphs, unsigned char *flags,
+                               size_t count, unsigned char literal) {
+  for (size_t i = 0; i < count; ++i) {
+    unsigned char d = glyphs[i] - '0';
+    flags[i] = d <= 9 ? literal : 0;
+  }
+}
+
+static void float_to_s16_scalar(const float *in, int16_t *out, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    float v = in[i];
+    out[i] = v < -1.00004566f  ? (int16_t)-32768
+             : v > 1.00001514f ? (int16_t)32767
+                               : (int16_t)(v * 32767.5f);
+  }
+}
+
+static void render_voices_scalar(tsf_voice_lanes &lanes, float *out,
+                                 int frames) {
+  for (int i = 0; i < lanes.count; ++i) {
+    const float *input = lanes.input[i];
+    unsigned base = lanes.base[i];
+    unsigned loop_start = lanes.loopStart[i], loop_end = lanes.loopEnd[i];
+    bool looping = loop_start < loop_end;
+    double loop_end_dbl = loop_end + 1.0;
+    double pos = lanes.position[i], end = lanes.end[i];
+    tsf_lowpass_real a0 = lanes.a0[i], a1 = lanes.a1[i], b1 = lanes.b1[i],
+                     b2 = lanes.b2[i], z1 = lanes.z1[i], z2 = lanes.z2[i];
+    float left = lanes.gainLeft[i], right = lanes.gainRight[i];
+
+    float *o = out;
+    for (int t = 0; t < frames && pos < end; ++t) {
+      unsigned p = (unsigned)pos;
+      unsigned next = p >= loop_end && looping ? loop_start : p + 1;
+      float alpha = (float)(pos - p);
+      tsf_lowpass_real in =
+          input[p - base] * (1.0f - alpha) + input[next - base] * alpha;
+
+      tsf_lowpass_real filtered = in * a0 + z1;
+      z1 = in * a1 + z2 - b1 * filtered;
+      z2 = in * a0 - b2 * filtered;
+      float val = (float)filtered;
+
+      *o++ += val * left;
+      *o++ += val * right;
+
+      pos += lanes.pitchRatio[i];
+      if (pos >= loop_end_dbl && looping)
+        pos -= loop_end - loop_start + 1.0;
+    }
+    lanes.position[i] = pos;
+    lanes.z1[i] = z1;
+    lanes.z2[i] = z2;
+  }
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse2"))) static void
+flag_digits_sse2(const char *glyphs, unsigned char *flags, size_t count,
+                 unsigned char literal) {
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i lit = _mm_set1_epi8(literal);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(glyphs + i));
+    // glyph - '0' <= 9 as unsigned bytes
+    __m128i d = _mm_sub_epi8(v, zero);
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+    _mm_storeu_si128((__m128i *)(flags + i), _mm_and_si128(is_digit, lit));
+  }
+
+  flag_digits_scalar(glyphs + i, flags + i, count - i, literal);
+}
+
+__attribute__((target("avx2"))) static void
+flag_digits_avx2(const char *glyphs, unsigned char *flags, size_t count,
+                 unsigned char literal) {
+  const __m256i zero = _mm256_set1_epi8('0');
+  const __m256i nine = _mm256_set1_epi8(9);
+  const __m256i lit = _mm256_set1_epi8(literal);
+
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(glyphs + i));
+    __m256i d = _mm256_sub_epi8(v, zero);
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, nine), d);
+    _mm256_storeu_si256((__m256i *)(flags + i),
+                        _mm256_and_si256(is_digit, lit));
+  }
+
+  flag_digits_sse2(glyphs + i, flags + i, count - i, literal);
+}
+
+// Clamping the scaled samples to [-32768, 32767] before truncating gives the
+// scalar results: what lies between the thresholds and the limits truncates
+// to the limits anyway.
+__attribute__((target("sse2"))) static void
+float_to_s16_sse2(const float *in, int16_t *out, size_t count) {
+  const __m128 scale = _mm_set1_ps(32767.5f);
+  const __m128 lo = _mm_set1_ps(-32768.f);
+  const __m128 hi = _mm_set1_ps(32767.f);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+    __m128i ia = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(a, lo), hi));
+    __m128i ib = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(b, lo), hi));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(ia, ib));
+  }
+
+  float_to_s16_scalar(in + i, out + i, count - i);
+}
+
+__attribute__((target("avx2"))) static void
+float_to_s16_avx2(const float *in, int16_t *out, size_t count) {
+  const __m256 scale = _mm256_set1_ps(32767.5f);
+  const __m256 lo = _mm256_set1_ps(-32768.f);
+  const __m256 hi = _mm256_set1_ps(32767.f);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+    __m256i ia = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(a, lo), hi));
+    __m256i ib = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(b, lo), hi));
+    // packs works within 128 bit lanes, put the quarters back in order
+    __m256i packed = _mm256_packs_epi32(ia, ib);
+    _mm256_storeu_si256((__m256i *)(out + i),
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+
+  float_to_s16_sse2(in + i, out + i, count - i);
+}
+
+// The low-pass filters of four voices, in the precision of tsf_lowpass_real.
+// Those of voices that stopped keep their state.
+#ifdef TSF_LOWPASS_FLOAT
+struct GroupLowpass {
+  __m128 a0, a1, b1, b2, z1, z2;
+};
+
+__attribute__((target("avx2"))) static void
+load_lowpass(GroupLowpass &f, const float *a0, const float *a1,
+             const float *b1, const float *b2, const float *z1,
+             const float *z2) {
+  f.a0 = _mm_load_ps(a0);
+  f.a1 = _mm_load_ps(a1);
+  f.b1 = _mm_load_ps(b1);
+  f.b2 = _mm_load_ps(b2);
+  f.z1 = _mm_load_ps(z1);
+  f.z2 = _mm_load_ps(z2);
+}
+
+__attribute__((target("avx2"))) static void
+store_lowpass(const GroupLowpass &f, float *z1, float *z2) {
+  _mm_store_ps(z1, f.z1);
+  _mm_store_ps(z2, f.z2);
+}
+
+__attribute__((target("avx2"), always_inline)) inline static __m128
+filter(GroupLowpass &f, __m128 in, __m128 live) {
+  __m128 out = _mm_add_ps(_mm_mul_ps(in, f.a0), f.z1);
+  __m128 z1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(in, f.a1), f.z2),
+                         _mm_mul_ps(f.b1, out));
+  __m128 z2 = _mm_sub_ps(_mm_mul_ps(in, f.a0), _mm_mul_ps(f.b2, out));
+  f.z1 = _mm_blendv_ps(f.z1, z1, live);
+  f.z2 = _mm_blendv_ps(f.z2, z2, live);
+  return out;
+}
+#else
+struct GroupLowpass {
+  __m256d a0, a1, b1, b2, z1, z2;
+};
+
+__attribute__((target("avx2"))) static void
+load_lowpass(GroupLowpass &f, const double *a0, const double *a1,
+             const double *b1, const double *b2, const double *z1,
+             const double *z2) {
+  f.a0 = _mm256_load_pd(a0);
+  f.a1 = _mm256_load_pd(a1);
+  f.b1 = _mm256_load_pd(b1);
+  f.b2 = _mm256_load_pd(b2);
+  f.z1 = _mm256_load_pd(z1);
+  f.z2 = _mm256_load_pd(z2);
+}
+
+__attribute__((target("avx2"))) static void
+store_lowpass(const GroupLowpass &f, double *z1, double *z2) {
+  _mm256_store_pd(z1, f.z1);
+  _mm256_store_pd(z2, f.z2);
+}
+
+__attribute__((target("avx2"), always_inline)) inline static __m128
+filter(GroupLowpass &f, __m128 sample, __m128 live) {
+  __m256d in = _mm256_cvtps_pd(sample);
+  __m256d mask =
+      _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_castps_si128(live)));
+  __m256d out = _mm256_add_pd(_mm256_mul_pd(in, f.a0), f.z1);
+  __m256d z1 = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(in, f.a1), f.z2),
+                             _mm256_mul_pd(f.b1, out));
+  __m256d z2 =
+      _mm256_sub_pd(_mm256_mul_pd(in, f.a0), _mm256_mul_pd(f.b2, out));
+  f.z1 = _mm256_blendv_pd(f.z1, z1, mask);
+  f.z2 = _mm256_blendv_pd(f.z2, z2, mask);
+  return _mm256_cvtpd_ps(out);
+}
+#endif
+
+// Four voices of tsf_voice_lanes: positions in doubles like
+// tsf_voice_render(), the samples in floats. A voice past its end stops, its
+// gathers are masked off and it adds zeros.
+struct VoiceGroup {
+  __m256d pos, step, end, loop_end, loop_length, looping, live;
+  GroupLowpass lowpass;
+  __m256i offset; // of sample position 0 from the origin, in bytes
+  __m128i loop_start, last, looping32;
+  __m128 gain_l, gain_r;
+};
+
+// voices [first, first + 4) of lanes, the missing ones past their end at 0
+__attribute__((target("avx2"))) static void
+load_voices(VoiceGroup &g, const tsf_voice_lanes &lanes, int first,
+            const float *origin) {
+  alignas(32) double pos[4] = {}, step[4] = {}, end[4] = {};
+  alignas(32) double loop_end[4] = {}, loop_length[4] = {};
+  alignas(32) tsf_lowpass_real a0[4] = {}, a1[4] = {}, b1[4] = {};
+  alignas(32) tsf_lowpass_real b2[4] = {}, z1[4] = {}, z2[4] = {};
+  alignas(32) int64_t offset[4] = {}, looping[4] = {};
+  alignas(16) int32_t loop_start[4] = {}, last[4] = {};
+  alignas(16) float gain_l[4] = {}, gain_r[4] = {};
+
+  for (int j = 0; j < 4 && first + j < lanes.count; ++j) {
+    int i = first + j;
+    pos[j] = lanes.position[i];
+    step[j] = lanes.pitchRatio[i];
+    end[j] = lanes.end[i];
+    loop_end[j] = lanes.loopEnd[i] + 1.0;
+    loop_length[j] = lanes.loopEnd[i] - lanes.loopStart[i] + 1.0;
+    looping[j] = lanes.loopStart[i] < lanes.loopEnd[i] ? -1 : 0;
+    loop_start[j] = lanes.loopStart[i];
+    last[j] = lanes.loopEnd[i] - 1;
+    a0[j] = lanes.a0[i];
+    a1[j] = lanes.a1[i];
+    b1[j] = lanes.b1[i];
+    b2[j] = lanes.b2[i];
+    z1[j] = lanes.z1[i];
+    z2[j] = lanes.z2[i];
+    offset[j] = (intptr_t)lanes.input[i] - (intptr_t)origin -
+                4 * (int64_t)lanes.base[i];
+    gain_l[j] = lanes.gainLeft[i];
+    gain_r[j] = lanes.gainRight[i];
+  }
+
+  // 64 bit masks to 32 bit ones
+  const __m256i low = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  __m256i loops = _mm256_load_si256((const __m256i *)looping);
+
+  g.pos = _mm256_load_pd(pos);
+  g.step = _mm256_load_pd(step);
+  g.end = _mm256_load_pd(end);
+  g.loop_end = _mm256_load_pd(loop_end);
+  g.loop_length = _mm256_load_pd(loop_length);
+  g.looping = _mm256_castsi256_pd(loops);
+  g.live = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  load_lowpass(g.lowpass, a0, a1, b1, b2, z1, z2);
+  g.offset = _mm256_load_si256((const __m256i *)offset);
+  g.loop_start = _mm_load_si128((const __m128i *)loop_start);
+  g.last = _mm_load_si128((const __m128i *)last);
+  g.looping32 =
+      _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(loops, low));
+  g.gain_l = _mm_load_ps(gain_l);
+  g.gain_r = _mm_load_ps(gain_r);
+}
+
+__attribute__((target("avx2"))) static void
+store_voices(const VoiceGroup &g, tsf_voice_lanes &lanes, int first) {
+  alignas(32) double pos[4];
+  alignas(32) tsf_lowpass_real z1[4], z2[4];
+  _mm256_store_pd(pos, g.pos);
+  store_lowpass(g.lowpass, z1, z2);
+  for (int j = 0; j < 4 && first + j < lanes.count; ++j) {
+    lanes.position[first + j] = pos[j];
+    lanes.z1[first + j] = z1[j];
+    lanes.z2[first + j] = z2[j];
+  }
+}
+
+// the next sample of each voice, moving them on
+__attribute__((target("avx2"), always_inline)) inline static __m128
+next_sample(VoiceGroup &g, const float *origin) {
+  const __m256i low = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+  g.live = _mm256_and_pd(g.live, _mm256_cmp_pd(g.pos, g.end, _CMP_LT_OQ));
+  __m128 mask = _mm_castsi128_ps(_mm256_castsi256_si128(
+      _mm256_permutevar8x32_epi32(_mm256_castpd_si256(g.live), low)));
+
+  __m128i at = _mm256_cvttpd_epi32(g.pos);
+  __m128 alpha = _mm256_cvtpd_ps(_mm256_sub_pd(g.pos, _mm256_cvtepi32_pd(at)));
+  __m128i wrap = _mm_and_si128(g.looping32, _mm_cmpgt_epi32(at, g.last));
+  __m128i next =
+      _mm_blendv_epi8(_mm_add_epi32(at, _mm_set1_epi32(1)), g.loop_start, wrap);
+
+  __m256i from = _mm256_add_epi64(
+      g.offset, _mm256_slli_epi64(_mm256_cvtepi32_epi64(at), 2));
+  __m256i to = _mm256_add_epi64(
+      g.offset, _mm256_slli_epi64(_mm256_cvtepi32_epi64(next), 2));
+  __m128 x0 = _mm256_mask_i64gather_ps(_mm_setzero_ps(), origin, from, mask, 1);
+  __m128 x1 = _mm256_mask_i64gather_ps(_mm_setzero_ps(), origin, to, mask, 1);
+  __m128 in = _mm_add_ps(_mm_mul_ps(x0, _mm_sub_ps(_mm_set1_ps(1.0f), alpha)),
+                         _mm_mul_ps(x1, alpha));
+  __m128 out = filter(g.lowpass, in, mask);
+
+  g.pos = _mm256_add_pd(g.pos, _mm256_and_pd(g.step, g.live));
+  __m256d back = _mm256_and_pd(_mm256_and_pd(g.live, g.looping),
+                               _mm256_cmp_pd(g.pos, g.loop_end, _CMP_GE_OQ));
+  g.pos = _mm256_sub_pd(g.pos, _mm256_and_pd(g.loop_length, back));
+
+  return _mm_and_ps(out, mask);
+}
+
+// Two groups of four voices at a time, their dependency chains interleaved.
+// The sums of each frame stay in the lanes of left and right until all the
+// voices are done.
+__attribute__((target("avx2"))) static void
+render_voices_avx2(tsf_voice_lanes &lanes, float *out, int frames) {
+  enum { CHUNK = 64 };
+  __m128 left[CHUNK], right[CHUNK];
+  const float *origin = lanes.count ? lanes.input[0] : nullptr;
+
+  for (int start = 0; start < frames; start += CHUNK) {
+    int n = frames - start < CHUNK ? frames - start : CHUNK;
+    for (int t = 0; t < n; ++t)
+      left[t] = right[t] = _mm_setzero_ps();
+
+    for (int first = 0; first < lanes.count; first += 8) {
+      VoiceGroup a, b;
+      load_voices(a, lanes, first, origin);
+
+      if (lanes.count - first <= 4) {
+        for (int t = 0; t < n; ++t) {
+          __m128 va = next_sample(a, origin);
+          left[t] = _mm_add_ps(left[t], _mm_mul_ps(va, a.gain_l));
+          right[t] = _mm_add_ps(right[t], _mm_mul_ps(va, a.gain_r));
+        }
+        store_voices(a, lanes, first);
+        continue;
+      }
+
+      load_voices(b, lanes, first + 4, origin);
+      for (int t = 0; t < n; ++t) {
+        __m128 va = next_sample(a, origin), vb = next_sample(b, origin);
+        left[t] = _mm_add_ps(left[t], _mm_add_ps(_mm_mul_ps(va, a.gain_l),
+                                                 _mm_mul_ps(vb, b.gain_l)));
+        right[t] = _mm_add_ps(right[t], _mm_add_ps(_mm_mul_ps(va, a.gain_r),
+                                                   _mm_mul_ps(vb, b.gain_r)));
+      }
+      store_voices(a, lanes, first);
+      store_voices(b, lanes, first + 4);
+    }
+
+    // two frames per store: l0 r0 l1 r1
+    float *o = out + 2 * start;
+    int t = 0;
+    for (; t + 2 <= n; t += 2, o += 4) {
+      __m128 sums = _mm_hadd_ps(_mm_hadd_ps(left[t], right[t]),
+                                _mm_hadd_ps(left[t + 1], right[t + 1]));
+      _mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), sums));
+    }
+    if (t < n) {
+      __m128 sums = _mm_hadd_ps(_mm_hadd_ps(left[t], right[t]), left[t]);
+      o[0] += _mm_cvtss_f32(sums);
+      o[1] += _mm_cvtss_f32(_mm_shuffle_ps(sums, sums, 1));
+    }
+  }
+}
+#endif
+
+SimdLevel simd_detect() {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SIMD_SSE2;
+#endif
+  return SIMD_SCALAR;
+}
+
+static SimdLevel simd_level() {
+  static const SimdLevel level = simd_detect();
+  return level;
+}
+
+void simd_flag_digits(SimdLevel level, const char *glyphs,
+                      unsigned char *flags, size_t count,
+                      unsigned char literal) {
+  switch (level) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    flag_digits_avx2(glyphs, flags, count, literal);
+    break;
+  case SIMD_SSE2:
+    flag_digits_sse2(glyphs, flags, count, literal);
+    break;
+#endif
+  default:
+    flag_digits_scalar(glyphs, flags, count, literal);
+    break;
+  }
+}
+
+void simd_flag_digits(const char *glyphs, unsigned char *flags, size_t count,
+                      unsigned char literal) {
+  simd_flag_digits(simd_level(), glyphs, flags, count, literal);
+}
+
+void simd_float_to_s16(SimdLevel level, const float *in, int16_t *out,
+                       size_t count) {
+  switch (level) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    float_to_s16_avx2(in, out, count);
+    break;
+  case SIMD_SSE2:
+    float_to_s16_sse2(in, out, count);
+    break;
+#endif
+  default:
+    float_to_s16_scalar(in, out, count);
+    break;
+  }
+}
+
+void simd_float_to_s16(const float *in, int16_t *out, size_t count) {
+  simd_float_to_s16(simd_level(), in, out, count);
+}
+
+void simd_render_voices(SimdLevel level, tsf_voice_lanes &lanes, float *out,
+                        int frames) {
+  switch (level) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    render_voices_avx2(lanes, out, frames);
+    break;
+#endif
+  default:
+    render_voices_scalar(lanes, out, frames);
+    break;
+  }
+}
+
+void simd_render_voices(tsf_voice_lanes &lanes, float *out, int frames) {
+  simd_render_voices(simd_level(), lanes, out, frames);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorized versions of the full-grid and per-block passes. The best
+// implementation for the running CPU is picked on first use, the scalar ones
+// work everywhere and are the reference the others are tested against.
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+// Best level supported by both the build and the running CPU.
+SimdLevel simd_detect();
+
+// flags[i] = literal if glyphs[i] is a decimal digit, 0 otherwise.
+void simd_flag_digits(const char *glyphs, unsigned char *flags, size_t count,
+                      unsigned char literal);
+void simd_flag_digits(SimdLevel level, const char *glyphs,
+                      unsigned char *flags, size_t count,
+                      unsigned char literal);
+
+// out[i] = in[i] scaled to 16 bit and clamped, rounding like
+// tsf_render_short(): toward zero from in[i] * 32767.5.
+void simd_float_to_s16(const float *in, int16_t *out, size_t count);
+void simd_float_to_s16(SimdLevel level, const float *in, int16_t *out,
+                       size_t count);
+
+struct tsf_voice_lanes;
+
+// Mixes the voices of lanes into out, interleaved stereo, leaving their
+// positions and filters where they stopped: the lanes renderer of the
+// soundfonts. AVX2 renders eight voices at a time, four to a vector of the
+// doubles tsf keeps positions and filters in. SSE2 would fit two, so below AVX2
+// the voices go one by one like in tsf_voice_render(), which the scalar
+// version matches exactly.
+void simd_render_voices(tsf_voice_lanes &lanes, float *out, int frames);
+void simd_render_voices(SimdLevel level, tsf_voice_lanes &lanes, float *out,
+                        int frames);
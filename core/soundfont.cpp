@@ -0,0 +1,325 @@
+#include "soundfont.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <limits.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOUNDFONT_POSIX
+#endif
+
+#define TSF_IMPLEMENTATION
+#include "tsf.h"
+
+// This is a minimal SoundFont with a single loopin saw-wave
+// sample/instrument/preset (484 bytes)
+const static unsigned char MinimalSoundFont[] = {
+#define TEN0 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    'R', 'I',  'F',  'F',  220,  1,    0,    0,    's',  'f',  'b',  'k',  'L',
+    'I', 'S',  'T',  88,   1,    0,    0,    'p',  'd',  't',  'a',  'p',  'h',
+    'd', 'r',  76,   TEN0, TEN0, TEN0, TEN0, 0,    0,    0,    0,    TEN0, 0,
+    0,   0,    0,    0,    0,    0,    255,  0,    255,  0,    1,    TEN0, 0,
+    0,   0,    'p',  'b',  'a',  'g',  8,    0,    0,    0,    0,    0,    0,
+    0,   1,    0,    0,    0,    'p',  'm',  'o',  'd',  10,   TEN0, 0,    0,
+    0,   'p',  'g',  'e',  'n',  8,    0,    0,    0,    41,   0,    0,    0,
+    0,   0,    0,    0,    'i',  'n',  's',  't',  44,   TEN0, TEN0, 0,    0,
+    0,   0,    0,    0,    0,    0,    TEN0, 0,    0,    0,    0,    0,    0,
+    0,   1,    0,    'i',  'b',  'a',  'g',  8,    0,    0,    0,    0,    0,
+    0,   0,    2,    0,    0,    0,    'i',  'm',  'o',  'd',  10,   TEN0, 0,
+    0,   0,    'i',  'g',  'e',  'n',  12,   0,    0,    0,    54,   0,    1,
+    0,   53,   0,    0,    0,    0,    0,    0,    0,    's',  'h',  'd',  'r',
+    92,  TEN0, TEN0, 0,    0,    0,    0,    0,    0,    0,    50,   0,    0,
+    0,   0,    0,    0,    0,    49,   0,    0,    0,    34,   86,   0,    0,
+    60,  0,    0,    0,    1,    TEN0, TEN0, TEN0, TEN0, 0,    0,    0,    0,
+    0,   0,    0,    'L',  'I',  'S',  'T',  112,  0,    0,    0,    's',  'd',
+    't', 'a',  's',  'm',  'p',  'l',  100,  0,    0,    0,    86,   0,    119,
+    3,   31,   7,    147,  10,   43,   14,   169,  17,   58,   21,   189,  24,
+    73,  28,   204,  31,   73,   35,   249,  38,   46,   42,   71,   46,   250,
+    48,  150,  53,   242,  55,   126,  60,   151,  63,   108,  66,   126,  72,
+    207, 70,   86,   83,   100,  72,   74,   100,  163,  39,   241,  163,  59,
+    175, 59,   179,  9,    179,  134,  187,  6,    186,  2,    194,  5,    194,
+    15,  200,  6,    202,  96,   206,  159,  209,  35,   213,  213,  216,  45,
+    220, 221,  223,  76,   227,  221,  230,  91,   234,  242,  237,  105,  241,
+    8,   245,  118,  248,  32,   252};
+
+namespace {
+
+// A file mapped read only, or read whole where it cannot be mapped.
+struct MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+  std::vector<char> buffer; // when read
+
+  MappedFile() {}
+  MappedFile(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#ifdef SOUNDFONT_POSIX
+    if (data && buffer.empty())
+      munmap((void *)data, size);
+#endif
+  }
+
+  bool open(const std::string &path) {
+#ifdef SOUNDFONT_POSIX
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      auto mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data = (const char *)mapped;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+    return data;
+#else
+    auto file = fopen(path.c_str(), "rb");
+    if (!file)
+      return false;
+
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+      buffer.insert(buffer.end(), chunk, chunk + read);
+    fclose(file);
+
+    data = buffer.data();
+    size = buffer.size();
+    return size;
+#endif
+  }
+};
+
+std::atomic<size_t> cache_limit(size_t(64) << 20);
+
+// The samples of a soundfont file, converted by the range a voice plays.
+// tsf_note_on() and the renders of machines on any thread acquire and
+// release them, so it has a lock of its own.
+struct SampleCache {
+  typedef std::pair<unsigned, unsigned> Range;
+
+  struct Converted {
+    std::vector<float> samples;
+    unsigned voices = 0;               // playing them
+    std::list<Range>::iterator unused; // while none is
+  };
+
+  MappedFile file;
+  tsf_sample_source source;
+
+  /* "private" */
+  std::mutex mutex;
+  std::map<Range, Converted> converted;
+  std::map<const float *, Range> ranges;
+  std::list<Range> unused; // least recently played first
+  size_t resident = 0;     // bytes
+
+  SampleCache() {
+    source = {this, &SampleCache::acquire, &SampleCache::release, nullptr, 0};
+  }
+
+  static const float *acquire(void *data, unsigned start, unsigned end) {
+    auto &cache = *(SampleCache *)data;
+    if (end <= start)
+      return nullptr;
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    Range range(start, end);
+    auto it = cache.converted.find(range);
+    if (it == cache.converted.end()) {
+      it = cache.converted.insert({range, Converted()}).first;
+      cache.convert(range, it->second.samples);
+      cache.ranges[it->second.samples.data()] = range;
+    } else if (!it->second.voices) {
+      cache.unused.erase(it->second.unused);
+    }
+
+    it->second.voices++;
+    cache.trim();
+    return it->second.samples.data();
+  }
+
+  static void release(void *data, const float *samples) {
+    auto &cache = *(SampleCache *)data;
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    auto range = cache.ranges.find(samples);
+    assert(range != cache.ranges.end());
+
+    auto &converted = cache.converted[range->second];
+    if (!--converted.voices)
+      converted.unused = cache.unused.insert(cache.unused.end(), range->second);
+    cache.trim();
+  }
+
+  // like tsf_load_samples(), the samples past the chunk are silent
+  void convert(Range range, std::vector<float> &out) {
+    auto in = (const unsigned char *)source.samples;
+    out.assign(range.second - range.first, 0.f);
+    for (unsigned i = range.first; i < range.second && i < source.sampleCount;
+         ++i)
+      out[i - range.first] =
+          (float)((int16_t)(in[2 * i] | in[2 * i + 1] << 8) / 32767.0);
+    resident += out.size() * sizeof(float);
+  }
+
+  void trim() {
+    while (resident > cache_limit && !unused.empty()) {
+      auto it = converted.find(unused.front());
+      unused.pop_front();
+      resident -= it->second.samples.size() * sizeof(float);
+      ranges.erase(it->second.samples.data());
+      converted.erase(it);
+    }
+  }
+};
+
+struct Loaded {
+  tsf *font = nullptr; // as loaded, never played
+  size_t copies = 0;   // open ones
+  std::unique_ptr<SampleCache> samples; // if loaded from a file
+};
+
+std::mutex mutex;
+std::map<std::string, Loaded> loaded; // by path, "" for the built-in one
+std::map<tsf *, std::string> copies;  // path of each open copy
+
+} // namespace
+
+static tsf *load_file(const std::string &path, Loaded &font) {
+  std::unique_ptr<SampleCache> samples(new SampleCache);
+  if (!samples->file.open(path) || samples->file.size > INT_MAX)
+    return nullptr;
+
+  font.font = tsf_load_memory_lazy(samples->file.data, samples->file.size,
+                                   &samples->source);
+  if (font.font)
+    font.samples = std::move(samples);
+  return font.font;
+}
+
+// mixes the voices of a block at once, copies inherit it
+static void render_voices(tsf_voice_lanes *lanes, float *buffer,
+                          int samples) {
+  simd_render_voices(*lanes, buffer, samples);
+}
+
+static tsf *open_loaded(const std::string &path) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  auto it = loaded.find(path);
+  if (it == loaded.end()) {
+    // loaded unlocked, machines opening and closing other copies meanwhile
+    // are not kept waiting
+    lock.unlock();
+
+    Loaded font;
+    if (path.empty())
+      font.font =
+          tsf_load_memory(MinimalSoundFont, sizeof(MinimalSoundFont));
+    else
+      load_file(path, font);
+
+    if (!font.font)
+      return nullptr;
+    tsf_set_lanes_renderer(font.font, render_voices);
+
+    lock.lock();
+    it = loaded.find(path);
+    if (it == loaded.end())
+      it = loaded.insert(std::make_pair(path, std::move(font))).first;
+    else
+      tsf_close(font.font); // another thread loaded it first
+  }
+
+  auto copy = tsf_copy(it->second.font);
+  it->second.copies++;
+  copies[copy] = path;
+  return copy;
+}
+
+tsf *open_soundfont() { return open_loaded(""); }
+
+tsf *open_soundfont(const std::string &path) {
+  // "" stands for the built-in one
+  return path.empty() ? nullptr : open_loaded(path);
+}
+
+void close_soundfont(tsf *copy) {
+  if (!copy)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = copies.find(copy);
+  assert(it != copies.end());
+
+  auto &font = loaded[it->second];
+  tsf_close(copy);
+  if (--font.copies == 0) {
+    tsf_close(font.font);
+    loaded.erase(it->second);
+  }
+  copies.erase(it);
+}
+
+size_t soundfonts_loaded() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return loaded.size();
+}
+
+std::vector<std::string> find_soundfonts(const std::vector<std::string> &dirs) {
+  std::vector<std::string> found;
+
+#ifdef SOUNDFONT_POSIX
+  for (auto &dir : dirs) {
+    auto listing = opendir(dir.c_str());
+    if (!listing)
+      continue;
+
+    while (auto entry = readdir(listing)) {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".sf2") == 0 ||
+                              name.compare(name.size() - 4, 4, ".SF2") == 0))
+        found.push_back(dir + "/" + name);
+    }
+    closedir(listing);
+  }
+#endif
+
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+void set_sample_cache_limit(size_t bytes) { cache_limit = bytes; }
+
+size_t samples_resident(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = loaded.find(path);
+  if (it == loaded.end() || !it->second.samples)
+    return 0;
+
+  auto &samples = *it->second.samples;
+  std::lock_guard<std::mutex> samples_lock(samples.mutex);
+  return samples.resident;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct tsf;
+
+// Soundfonts shared by the machines playing them. Each one is loaded once and
+// every machine gets a tsf_copy() of it: the presets, regions and samples are
+// only read after loading so they are shared, the voices and channels are the
+// machine's own. Once the last copy is closed the soundfont is freed.
+//
+// tsf_copy() and tsf_close() count the copies without locking, these take a
+// lock so machines can come and go on any thread.
+
+// a copy of the built-in soundfont
+tsf *open_soundfont();
+
+// a copy of the .sf2 file at path, loaded on first use, null if it cannot be
+// loaded
+//
+// The file is mapped in memory and only its presets are read up front, the
+// samples a region plays are converted to float when a note first plays it.
+tsf *open_soundfont(const std::string &path);
+
+void close_soundfont(tsf *copy);
+
+// Converted samples kept per soundfont file once no note plays them, the
+// least recently played are dropped past it. Samples still playing are kept
+// whatever the limit.
+void set_sample_cache_limit(size_t bytes);
+
+// the .sf2 files in dirs, sorted, skipping the dirs that do not exist
+std::vector<std::string> find_soundfonts(const std::vector<std::string> &dirs);
+
+// soundfonts loaded, for tests
+size_t soundfonts_loaded();
+
+// bytes of converted samples the soundfont at path holds, for tests
+size_t samples_resident(const std::string &path);
+
+// A copy of a shared soundfont, closed along with its owner.
+struct SoundFontCopy {
+  tsf *font = nullptr;
+
+  SoundFontCopy() {}
+  SoundFontCopy(const SoundFontCopy &) = delete;
+  SoundFontCopy(SoundFontCopy &&other) : font(other.font) {
+    other.font = nullptr;
+  }
+  ~SoundFontCopy() { close_soundfont(font); }
+
+  SoundFontCopy &operator=(SoundFontCopy &&other) {
+    if (this != &other) {
+      close_soundfont(font);
+      font = other.font;
+      other.font = nullptr;
+    }
+    return *this;
+  }
+
+  SoundFontCopy &operator=(tsf *copy) {
+    close_soundfont(font);
+    font = copy;
+    return *this;
+  }
+
+  // the copy, which the caller now has to close
+  tsf *release() {
+    auto copy = font;
+    font = nullptr;
+    return copy;
+  }
+
+  operator tsf *() const { return font; }
+};
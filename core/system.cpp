@@ -2,6 +2,8 @@
 #include "machine.hpp"
 #include "util.hpp"
 
+#include <chrono>
+
 const std::array<std::array<char, 10>, 5> System::InsertMenu::ITEMS = {
     {{'0', '1', '2', '3', '4', '5', '6', '7', '8', '9'},
      {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J'},
@@ -9,6 +11,10 @@ const std::array<std::array<char, 10>, 5> System::InsertMenu::ITEMS = {
      {'U', 'V', 'W', 'X', 'Y', 'Z', '*', '#', ':', '%'},
      {'!', '?', ';', '=', '$', '.', '.', '.', '.', '.'}}};
 
+const std::vector<std::string> System::SOUNDFONT_DIRS = {
+    "/usr/share/soundfonts", "/usr/share/sounds/sf2",
+    "/usr/local/share/soundfonts"};
+
 System::System() {}
 
 void System::set_size(int width, int height) {
@@ -72,6 +78,15 @@ void System::handle_input(const SimpleInput &new_input) {
                                              });
         font_menu.open(options_menu.x + 1, 1 + options_menu.selected);
       } else if (option == UI_OPT_SOUNDFONT) {
+        soundfont_paths = find_soundfonts(SOUNDFONT_DIRS);
+        soundfont_paths.insert(soundfont_paths.begin(), "");
+
+        soundfont_menu = PopupList("Select sound font", {});
+        for (auto &path : soundfont_paths)
+          soundfont_menu.items.push_back(
+              path.empty() ? "built-in"
+                           : path.substr(path.find_last_of('/') + 1));
+        soundfont_menu.open(options_menu.x + 1, 1 + options_menu.selected);
       }
     } else if (input.backspace || input.del)
       options_menu.cancel();
@@ -85,6 +100,14 @@ void System::handle_input(const SimpleInput &new_input) {
     } else if (input.backspace || input.del)
       font_menu.cancel();
 
+  } else if (soundfont_menu.is_open) {
+    soundfont_menu.move_cursor(input.down - input.up);
+
+    if (input.enter || input.ins)
+      load_soundfont(soundfont_paths[soundfont_menu.accept_int()]);
+    else if (input.backspace || input.del)
+      soundfont_menu.cancel();
+
   } else {
     Vec2i p = cursor;
     p.x += input.right - input.left;
@@ -94,7 +117,7 @@ void System::handle_input(const SimpleInput &new_input) {
       cursor = p;
 
     if (pressed.ins) {
-      auto cur_char = machine.get_cell(cursor.x, cursor.y)->c;
+      auto cur_char = machine.get_cell(cursor.x, cursor.y).c;
       insert_menu.open(cursor.x, cursor.y,
                        cur_char == '.' ? Cell::Glyph('O') : cur_char);
     } else if (pressed.enter) {
@@ -104,6 +127,58 @@ void System::handle_input(const SimpleInput &new_input) {
   }
 }
 
+void System::load_soundfont(const std::string &path, tsf *unwanted) {
+  // dropping the future of a load still going would wait for it
+  if (loading_soundfont.valid()) {
+    queued_soundfont = path;
+    has_queued_soundfont = true;
+    return;
+  }
+
+  loading_soundfont = std::async(std::launch::async, [path, unwanted] {
+    close_soundfont(unwanted);
+    auto font = path.empty() ? open_soundfont() : open_soundfont(path);
+    if (font)
+      Machine::prepare_soundfont(font);
+    return font;
+  });
+}
+
+void System::run() {
+  if (loading_soundfont.valid() &&
+      loading_soundfont.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    auto font = loading_soundfont.get();
+
+    if (has_queued_soundfont) {
+      has_queued_soundfont = false;
+      load_soundfont(queued_soundfont, font);
+    } else if (font) {
+      machine.switch_soundfont(font);
+    }
+  }
+
+  machine.run();
+
+  // dropping the future of a close still going would wait for it, the machine
+  // keeps the fonts until then
+  if (!machine.retired_sf.empty() &&
+      (!closing_soundfont.valid() ||
+       closing_soundfont.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready)) {
+    std::vector<tsf *> fonts;
+    for (auto &copy : machine.retired_sf)
+      fonts.push_back(copy.release());
+    // clear() keeps the capacity, retiring the next one allocates nothing
+    machine.retired_sf.clear();
+
+    closing_soundfont = std::async(std::launch::async, [fonts] {
+      for (auto font : fonts)
+        close_soundfont(font);
+    });
+  }
+}
+
 void System::draw() {
   term.clear();
 
@@ -127,35 +202,35 @@ void System::draw() {
   for (int y = 0; y < grid_h; ++y) {
     for (int x = 0; x < grid_w; ++x) {
       auto cell = machine.get_cell(x, y);
-      char ch = cell->c;
+      char ch = cell.c;
 
       // highlighted cell
-      if (UNLIKELY(cursor_cell->c == ch && !(ch == '.' || ch == '#')))
+      if (UNLIKELY(cursor_cell.c == ch && !(ch == '.' || ch == '#')))
         term.putc(ch, x, y, 7, 0);
       // read unlocked or read written
-      else if (cell->flags & CF_WAS_READ &&
-               ((cell->flags & CF_IS_LITERAL) == 0 ||
-                cell->flags & CF_WAS_WRITTEN))
+      else if (cell.flags & CF_WAS_READ &&
+               ((cell.flags & CF_IS_LITERAL) == 0 ||
+                cell.flags & CF_WAS_WRITTEN))
         term.putc(ch, x, y, 6, 0);
       // read locked
-      else if (cell->flags & CF_WAS_READ && cell->flags & CF_IS_LITERAL)
+      else if (cell.flags & CF_WAS_READ && cell.flags & CF_IS_LITERAL)
         term.putc(ch, x, y, 1, 0);
       // write locked
-      else if (cell->flags & CF_WAS_WRITTEN)
+      else if (cell.flags & CF_WAS_WRITTEN)
         term.putc(ch, x, y, 0, 1);
       // literals
-      else if (cell->flags & CF_IS_LITERAL) {
-        if (cell->flags & CF_WAS_BANGED && ch == '*')
+      else if (cell.flags & CF_IS_LITERAL) {
+        if (cell.flags & CF_WAS_BANGED && ch == '*')
           term.putc(ch, x, y, 1, 0);
         else
           term.putc(ch, x, y, 4, 0);
       }
       // operator, except for NSEW
-      else if (cell->flags & CF_WAS_TICKED &&
+      else if (cell.flags & CF_WAS_TICKED &&
                (ch != 'E' && ch != 'W' && ch != 'S' && ch != 'N' &&
                 ch != '.')) {
         // blink these.
-        if (cell->flags & CF_WAS_BANGED && (ch == '%' || ch == ':'))
+        if (cell.flags & CF_WAS_BANGED && (ch == '%' || ch == ':'))
           term.putc(' ', x, y, 0, 0);
         else if (ch == '*')
           term.putc(ch, x, y, 1, 0);
@@ -172,15 +247,18 @@ void System::draw() {
     options_menu.draw(term);
   } else if (font_menu.is_open) {
     font_menu.draw(term);
+  } else if (soundfont_menu.is_open) {
+    soundfont_menu.draw(term);
   } else {
-    term.putc(cursor_cell->c == '.' ? '@' : (char)cursor_cell->c, cursor.x,
+    term.putc(cursor_cell.c == '.' ? '@' : (char)cursor_cell.c, cursor.x,
               cursor.y, 0, 7);
   }
 
   term.reset_color();
   term.print(0, grid_h + 0, " %10s   %02i,%02i %8uf",
-             machine.cell_descs[cursor.y][cursor.x], cursor.x, cursor.y,
-             machine.ticks);
-  term.print(0, grid_h + 1, " %10s   %2s %2s %8u%c", "", "", "", machine.bpm,
-             machine.ticks % 4 == 0 ? '*' : ' ');
+             machine.describe(cursor.x, cursor.y).c_str(), cursor.x,
+             cursor.y, machine.ticks);
+  term.print(0, grid_h + 1, " %10s   %2s %2s %8u%c",
+             loading_soundfont.valid() ? "loading sf" : "", "", "",
+             machine.bpm, machine.ticks % 4 == 0 ? '*' : ' ');
 }
@@ -4,8 +4,10 @@
 #include "terminal.hpp"
 #include "util.hpp"
 #include <array>
+#include <future>
 #include <memory>
 #include <string.h>
+#include <vector>
 
 struct System {
   static constexpr const std::array<char, 46> CURSOR_CHARS = {
@@ -265,10 +267,30 @@ struct System {
   PopupList options_menu{"OPTIONS", {"Resume", "Font...", "Sound font..."}};
   PopupList font_menu;
 
+  // where the sound font menu looks for .sf2 files
+  static const std::vector<std::string> SOUNDFONT_DIRS;
+  PopupList soundfont_menu;
+  std::vector<std::string> soundfont_paths; // of its items, "" is built-in
+
+  // The sound font loading on its own thread, switched to once loaded, and
+  // the one picked meanwhile, loaded after it instead.
+  std::future<tsf *> loading_soundfont;
+  std::string queued_soundfont;
+  bool has_queued_soundfont = false;
+
+  // The machine's retired sound fonts being closed on their own thread,
+  // closing the last copy unmaps the file.
+  std::future<void> closing_soundfont;
+
   System();
 
   void set_size(int width, int height);
   void handle_input(const SimpleInput &input);
 
+  // a frame of the machine, switching sound fonts as they finish loading
+  void run();
+  // unwanted, if any, is closed on the loading thread first
+  void load_soundfont(const std::string &path, tsf *unwanted = nullptr);
+
   void draw();
 };
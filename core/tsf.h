@@ -13,6 +13,8 @@
    [OPTIONAL] #define TSF_MALLOC, TSF_REALLOC, and TSF_FREE to avoid stdlib.h
    [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET to avoid string.h
    [OPTIONAL] #define TSF_POW, TSF_POWF, TSF_EXPF, TSF_LOG, TSF_TAN, TSF_LOG10, TSF_SQRT to avoid math.h
+   [OPTIONAL] #define TSF_LOWPASS_FLOAT to run the low-pass filters in single precision, zeroing their state when it dies
+              down instead of going denormal (define it for every file including this one)
 
    NOT YET IMPLEMENTED
      - Support for ChorusEffectsSend and ReverbEffectsSend generators
@@ -89,6 +91,36 @@ struct tsf_stream
 // Generic SoundFont loading method using the stream structure above
 TSFDEF tsf* tsf_load(struct tsf_stream* stream);
 
+// Sample data converted to float on demand, for tsf_load_memory_lazy
+struct tsf_sample_source
+{
+	// Custom data given to the functions as the first parameter
+	void* data;
+
+	// Function pointer will be called when a voice starts, to get the samples [start, end) of the
+	// sample chunk as floats (returns TSF_NULL to leave the voice silent)
+	const float* (*acquire)(void* data, unsigned int start, unsigned int end);
+
+	// Function pointer will be called when that voice ends, with the samples acquire returned
+	void (*release)(void* data, const float* samples);
+
+	// The 16-bit little endian sample chunk inside the loaded buffer and its length in samples,
+	// set by tsf_load_memory_lazy
+	const void* samples;
+	unsigned int sampleCount;
+};
+
+// Load a SoundFont from a block of memory, like tsf_load_memory, but without converting the
+// samples up front. They stay in the buffer and the voices get them from source as they start.
+// The buffer and source need to stay valid until the instance and all its copies are closed.
+TSFDEF tsf* tsf_load_memory_lazy(const void* buffer, int size, struct tsf_sample_source* source);
+
+// Copy a tsf instance from an existing one, use tsf_close to close it as well.
+// All copied tsf instances and their original instance are linked, and share the underlying soundfont.
+// This allows loading a soundfont only once, but using it for multiple independent playbacks.
+// (This function isn't thread-safe without locking.)
+TSFDEF tsf* tsf_copy(tsf* f);
+
 // Free the memory related to this tsf instance
 TSFDEF void tsf_close(tsf* f);
 
@@ -160,6 +192,36 @@ TSFDEF int tsf_active_voice_count(tsf* f);
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 
+// Type of the low-pass filter coefficients and state, double unless TSF_LOWPASS_FLOAT is defined
+#ifdef TSF_LOWPASS_FLOAT
+typedef float tsf_lowpass_real;
+#else
+typedef double tsf_lowpass_real;
+#endif
+
+// Voices mixed side by side over a block of TSF_STEREO_INTERLEAVED output, as structure of
+// arrays. Voice i reads input[i], whose first sample is at sample position base[i], from
+// position[i] on, advancing by pitchRatio[i] per output sample and wrapping from loopEnd[i] back
+// to loopStart[i] while loopStart[i] < loopEnd[i]. It stops at end[i]. Each interpolated sample
+// goes through the low-pass biquad a0[i], a1[i], b1[i], b2[i] with the state z1[i], z2[i]
+// (a0 = 1 and the others 0 pass it through), then is added to the output times gainLeft[i] and
+// gainRight[i]. The renderer leaves position[i], z1[i] and z2[i] where the voice stopped,
+// position[i] at or past end[i] if it got there.
+struct tsf_voice_lanes
+{
+	int count;
+	const float** input;
+	unsigned int *base, *loopStart, *loopEnd;
+	double *position, *pitchRatio, *end;
+	tsf_lowpass_real *a0, *a1, *b1, *b2, *z1, *z2;
+	float *gainLeft, *gainRight;
+};
+
+// Render TSF_STEREO_INTERLEAVED output block by block, with render mixing all the voices at
+// once, instead of one voice after the other (TSF_NULL to go back to that). Copies made
+// afterwards use the same function.
+TSFDEF void tsf_set_lanes_renderer(tsf* f, void (*render)(struct tsf_voice_lanes* lanes, float* buffer, int samples));
+
 // Higher level channel based functions, set up channel parameters
 //   channel: channel number
 //   preset_index: preset index >= 0 and < tsf_get_presetcount()
@@ -294,6 +356,13 @@ struct tsf
 	enum TSFOutputMode outputmode;
 	float outSampleRate;
 	float globalGainDB;
+	int* refCount;
+	struct tsf_sample_source* sampleSource;
+
+	void (*lanesRenderer)(struct tsf_voice_lanes* lanes, float* buffer, int samples);
+	struct tsf_voice_lanes lanes;
+	struct tsf_voice** laneVoices;
+	int laneSize;
 };
 
 #ifndef TSF_NO_STDIO
@@ -333,6 +402,17 @@ TSFDEF tsf* tsf_load_memory(const void* buffer, int size)
 	return tsf_load(&stream);
 }
 
+static tsf* tsf_load_internal(struct tsf_stream* stream, struct tsf_stream_memory* lazyMemory, struct tsf_sample_source* lazySource);
+TSFDEF tsf* tsf_load_memory_lazy(const void* buffer, int size, struct tsf_sample_source* source)
+{
+	struct tsf_stream stream = { TSF_NULL, (int(*)(void*,void*,unsigned int))&tsf_stream_memory_read, (int(*)(void*,unsigned int))&tsf_stream_memory_skip };
+	struct tsf_stream_memory f = { 0, 0, 0 };
+	f.buffer = (const char*)buffer;
+	f.total = size;
+	stream.data = &f;
+	return tsf_load_internal(&stream, &f, source);
+}
+
 enum { TSF_LOOPMODE_NONE, TSF_LOOPMODE_CONTINUOUS, TSF_LOOPMODE_SUSTAIN };
 
 enum { TSF_SEGMENT_NONE, TSF_SEGMENT_DELAY, TSF_SEGMENT_ATTACK, TSF_SEGMENT_HOLD, TSF_SEGMENT_DECAY, TSF_SEGMENT_SUSTAIN, TSF_SEGMENT_RELEASE, TSF_SEGMENT_DONE };
@@ -371,7 +451,7 @@ static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, struct tsf_stream* str
 struct tsf_riffchunk { tsf_fourcc id; tsf_u32 size; };
 struct tsf_envelope { float delay, attack, hold, decay, sustain, release, keynumToHold, keynumToDecay; };
 struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; short segment, midiVelocity; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, isAmpEnv; };
-struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
+struct tsf_voice_lowpass { double QInv; tsf_lowpass_real a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
 struct tsf_voice_lfo { int samplesUntil; float level, delta; };
 
 struct tsf_region
@@ -407,6 +487,8 @@ struct tsf_voice
 	double sourceSamplePosition;
 	float  noteGainDB, panFactorLeft, panFactorRight;
 	unsigned int playIndex, loopStart, loopEnd;
+	const float* samples; // from the sample source, starting at samplesStart
+	unsigned int samplesStart;
 	struct tsf_voice_envelope ampenv, modenv;
 	struct tsf_voice_lowpass lowpass;
 	struct tsf_voice_lfo modlfo, viblfo;
@@ -961,15 +1043,27 @@ static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
 	// Lowpass filter from http://www.earlevel.com/main/2012/11/26/biquad-c-source-code/
 	double K = TSF_TAN(TSF_PI * Fc), KK = K * K;
 	double norm = 1 / (1 + K * e->QInv + KK);
-	e->a0 = KK * norm;
+	e->a0 = (tsf_lowpass_real)(KK * norm);
 	e->a1 = 2 * e->a0;
-	e->b1 = 2 * (KK - 1) * norm;
-	e->b2 = (1 - K * e->QInv + KK) * norm;
+	e->b1 = (tsf_lowpass_real)(2 * (KK - 1) * norm);
+	e->b2 = (tsf_lowpass_real)((1 - K * e->QInv + KK) * norm);
 }
 
-static float tsf_voice_lowpass_process(struct tsf_voice_lowpass* e, double In)
+static float tsf_voice_lowpass_process(struct tsf_voice_lowpass* e, tsf_lowpass_real In)
 {
-	double Out = In * e->a0 + e->z1; e->z1 = In * e->a1 + e->z2 - e->b1 * Out; e->z2 = In * e->a0 - e->b2 * Out; return (float)Out;
+	tsf_lowpass_real Out = In * e->a0 + e->z1; e->z1 = In * e->a1 + e->z2 - e->b1 * Out; e->z2 = In * e->a0 - e->b2 * Out; return (float)Out;
+}
+
+// Zero the state of a filter that died down before it gets denormal, which is slow to compute
+// with in single precision. Called after each block.
+static void tsf_voice_lowpass_flush(struct tsf_voice_lowpass* e)
+{
+#ifdef TSF_LOWPASS_FLOAT
+	if (e->z1 > -1e-20f && e->z1 < 1e-20f) e->z1 = 0;
+	if (e->z2 > -1e-20f && e->z2 < 1e-20f) e->z2 = 0;
+#else
+	(void)e;
+#endif
 }
 
 static void tsf_voice_lfo_setup(struct tsf_voice_lfo* e, float delay, int freqCents, float outSampleRate)
@@ -987,9 +1081,10 @@ static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
 	else if (e->level < -1.0f) { e->delta = -e->delta; e->level = -2.0f - e->level; }
 }
 
-static void tsf_voice_kill(struct tsf_voice* v)
+static void tsf_voice_kill(tsf* f, struct tsf_voice* v)
 {
 	v->playingPreset = -1;
+	if (v->samples) { f->sampleSource->release(f->sampleSource->data, v->samples); v->samples = TSF_NULL; }
 }
 
 static void tsf_voice_end(struct tsf_voice* v, float outSampleRate)
@@ -1021,7 +1116,8 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, floa
 static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
 {
 	struct tsf_region* region = v->region;
-	float* input = f->fontSamples;
+	const float* input = (v->samples ? v->samples : f->fontSamples);
+	unsigned int base = (v->samples ? v->samplesStart : 0); // sample position of input[0]
 	float* outL = outputBuffer;
 	float* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
 
@@ -1093,7 +1189,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos - base] * (1.0f - alpha) + input[nextPos - base] * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1114,7 +1210,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos - base] * (1.0f - alpha) + input[nextPos - base] * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1134,7 +1230,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos - base] * (1.0f - alpha) + input[nextPos - base] * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1148,9 +1244,11 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 				break;
 		}
 
+		if (tmpLowpass.active) tsf_voice_lowpass_flush(&tmpLowpass);
+
 		if (tmpSourceSamplePosition >= tmpSampleEndDbl || v->ampenv.segment == TSF_SEGMENT_DONE)
 		{
-			tsf_voice_kill(v);
+			tsf_voice_kill(f, v);
 			return;
 		}
 	}
@@ -1160,6 +1258,11 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 }
 
 TSFDEF tsf* tsf_load(struct tsf_stream* stream)
+{
+	return tsf_load_internal(stream, TSF_NULL, TSF_NULL);
+}
+
+static tsf* tsf_load_internal(struct tsf_stream* stream, struct tsf_stream_memory* lazyMemory, struct tsf_sample_source* lazySource)
 {
 	tsf* res = TSF_NULL;
 	struct tsf_riffchunk chunkHead;
@@ -1207,7 +1310,15 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		{
 			while (tsf_riffchunk_read(&chunkList, &chunk, stream))
 			{
-				if (TSF_FourCCEquals(chunk.id, "smpl"))
+				if (TSF_FourCCEquals(chunk.id, "smpl") && lazySource)
+				{
+					// Leave the samples in memory for the source to convert.
+					if (chunk.size > lazyMemory->total - lazyMemory->pos) chunk.size = lazyMemory->total - lazyMemory->pos;
+					lazySource->samples = lazyMemory->buffer + lazyMemory->pos;
+					lazySource->sampleCount = fontSampleCount = chunk.size / sizeof(short);
+					stream->skip(stream->data, chunk.size);
+				}
+				else if (TSF_FourCCEquals(chunk.id, "smpl"))
 				{
 					tsf_load_samples(&fontSamples, &fontSampleCount, &chunk, stream);
 				}
@@ -1220,7 +1331,7 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	{
 		//if (e) *e = TSF_INVALID_INCOMPLETE;
 	}
-	else if (fontSamples == TSF_NULL)
+	else if (fontSamples == TSF_NULL && !(lazySource && lazySource->samples))
 	{
 		//if (e) *e = TSF_INVALID_NOSAMPLEDATA;
 	}
@@ -1232,6 +1343,9 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetNum * sizeof(struct tsf_preset));
 		res->fontSamples = fontSamples;
 		res->outSampleRate = 44100.0f;
+		res->refCount = (int*)TSF_MALLOC(sizeof(int));
+		*res->refCount = 1;
+		res->sampleSource = lazySource;
 		fontSamples = TSF_NULL; //don't free below
 		tsf_load_presets(res, &hydra, fontSampleCount);
 	}
@@ -1242,17 +1356,47 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	return res;
 }
 
+TSFDEF tsf* tsf_copy(tsf* f)
+{
+	tsf* res;
+	if (!f) return TSF_NULL;
+	res = (tsf*)TSF_MALLOC(sizeof(tsf));
+	TSF_MEMCPY(res, f, sizeof(tsf));
+	res->voices = TSF_NULL;
+	res->voiceNum = 0;
+	res->channels = TSF_NULL;
+	res->outputSamples = TSF_NULL;
+	res->outputSampleSize = 0;
+	TSF_MEMSET(&res->lanes, 0, sizeof(res->lanes));
+	res->laneVoices = TSF_NULL;
+	res->laneSize = 0;
+	(*res->refCount)++;
+	return res;
+}
+
 TSFDEF void tsf_close(tsf* f)
 {
 	struct tsf_preset *preset, *presetEnd;
+	struct tsf_voice *v, *vEnd;
 	if (!f) return;
-	for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
-		TSF_FREE(preset->regions);
-	TSF_FREE(f->presets);
-	TSF_FREE(f->fontSamples);
+	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+		if (v->playingPreset != -1) tsf_voice_kill(f, v);
+	if (!--(*f->refCount))
+	{
+		for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
+			TSF_FREE(preset->regions);
+		TSF_FREE(f->presets);
+		TSF_FREE(f->fontSamples);
+		TSF_FREE(f->refCount);
+	}
 	TSF_FREE(f->voices);
 	if (f->channels) { TSF_FREE(f->channels->channels); TSF_FREE(f->channels); }
 	TSF_FREE(f->outputSamples);
+	TSF_FREE(f->lanes.input); TSF_FREE(f->lanes.base); TSF_FREE(f->lanes.loopStart); TSF_FREE(f->lanes.loopEnd);
+	TSF_FREE(f->lanes.position); TSF_FREE(f->lanes.pitchRatio); TSF_FREE(f->lanes.end);
+	TSF_FREE(f->lanes.a0); TSF_FREE(f->lanes.a1); TSF_FREE(f->lanes.b1); TSF_FREE(f->lanes.b2);
+	TSF_FREE(f->lanes.z1); TSF_FREE(f->lanes.z2);
+	TSF_FREE(f->lanes.gainLeft); TSF_FREE(f->lanes.gainRight); TSF_FREE(f->laneVoices);
 	TSF_FREE(f);
 }
 
@@ -1328,6 +1472,7 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 			f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
             voice = &f->voices[f->voiceNum - 4];
 			voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
+			voice[0].samples = voice[1].samples = voice[2].samples = voice[3].samples = TSF_NULL;
 		}
 
 		voice->region = region;
@@ -1356,6 +1501,16 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		voice->loopStart = (doLoop ? region->loop_start : 0);
 		voice->loopEnd = (doLoop ? region->loop_end : 0);
 
+		// Samples, up to the one interpolated with the last.
+		if (f->sampleSource)
+		{
+			unsigned int end = (voice->loopEnd >= region->end ? voice->loopEnd + 1 : region->end) + 1;
+			voice->samplesStart = (doLoop && region->loop_start < region->offset ? region->loop_start : region->offset);
+			if (voice->samples) f->sampleSource->release(f->sampleSource->data, voice->samples);
+			voice->samples = f->sampleSource->acquire(f->sampleSource->data, voice->samplesStart, end);
+			if (!voice->samples) { voice->playingPreset = -1; continue; }
+		}
+
 		// Setup envelopes.
 		tsf_voice_envelope_setup(&voice->ampenv, &region->ampenv, key, midiVelocity, TSF_TRUE, f->outSampleRate);
 		tsf_voice_envelope_setup(&voice->modenv, &region->modenv, key, midiVelocity, TSF_FALSE, f->outSampleRate);
@@ -1455,11 +1610,126 @@ TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing
 		}
 }
 
+static TSF_BOOL tsf_lanes_reserve(tsf* f, int size)
+{
+	struct tsf_voice_lanes* l = &f->lanes;
+	if (f->laneSize >= size) return TSF_TRUE;
+	TSF_FREE(l->input); TSF_FREE(l->base); TSF_FREE(l->loopStart); TSF_FREE(l->loopEnd);
+	TSF_FREE(l->position); TSF_FREE(l->pitchRatio); TSF_FREE(l->end);
+	TSF_FREE(l->a0); TSF_FREE(l->a1); TSF_FREE(l->b1); TSF_FREE(l->b2); TSF_FREE(l->z1); TSF_FREE(l->z2);
+	TSF_FREE(l->gainLeft); TSF_FREE(l->gainRight); TSF_FREE(f->laneVoices);
+	l->input = (const float**)TSF_MALLOC(size * sizeof(const float*));
+	l->base = (unsigned int*)TSF_MALLOC(size * sizeof(unsigned int));
+	l->loopStart = (unsigned int*)TSF_MALLOC(size * sizeof(unsigned int));
+	l->loopEnd = (unsigned int*)TSF_MALLOC(size * sizeof(unsigned int));
+	l->position = (double*)TSF_MALLOC(size * sizeof(double));
+	l->pitchRatio = (double*)TSF_MALLOC(size * sizeof(double));
+	l->end = (double*)TSF_MALLOC(size * sizeof(double));
+	l->a0 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->a1 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->b1 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->b2 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->z1 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->z2 = (tsf_lowpass_real*)TSF_MALLOC(size * sizeof(tsf_lowpass_real));
+	l->gainLeft = (float*)TSF_MALLOC(size * sizeof(float));
+	l->gainRight = (float*)TSF_MALLOC(size * sizeof(float));
+	f->laneVoices = (struct tsf_voice**)TSF_MALLOC(size * sizeof(struct tsf_voice*));
+	f->laneSize = (l->input && l->base && l->loopStart && l->loopEnd && l->position && l->pitchRatio && l->end && l->a0 && l->a1 && l->b1 && l->b2 && l->z1 && l->z2 && l->gainLeft && l->gainRight && f->laneVoices ? size : 0);
+	return (f->laneSize != 0);
+}
+
+// The block parameters of tsf_voice_render for a voice, handed to the lanes renderer instead
+// of rendered here.
+static void tsf_voice_lane(tsf* f, struct tsf_voice* v, int blockSamples)
+{
+	struct tsf_region* region = v->region;
+	struct tsf_voice_lanes* l = &f->lanes;
+	int i = l->count++;
+	double pitchRatio;
+	float noteGain, gainMono;
+
+	if (region->modLfoToFilterFc || region->modEnvToFilterFc)
+	{
+		float fres = (float)region->initialFilterFc + v->modlfo.level * (float)region->modLfoToFilterFc + v->modenv.level * (float)region->modEnvToFilterFc;
+		float lowpassFc = (fres <= 13500 ? tsf_cents2Hertz(fres) / f->outSampleRate : 1.0f);
+		v->lowpass.active = (lowpassFc < 0.499f);
+		if (v->lowpass.active) tsf_voice_lowpass_setup(&v->lowpass, lowpassFc);
+	}
+
+	if (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch)
+		pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * (float)region->modLfoToPitch + v->viblfo.level * (float)region->vibLfoToPitch + v->modenv.level * (float)region->modEnvToPitch)) * v->pitchOutputFactor;
+	else
+		pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor;
+
+	if (region->modLfoToVolume)
+		noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * ((float)region->modLfoToVolume * 0.1f)));
+	else
+		noteGain = tsf_decibelsToGain(v->noteGainDB);
+
+	gainMono = noteGain * v->ampenv.level;
+
+	tsf_voice_envelope_process(&v->ampenv, blockSamples, f->outSampleRate);
+	if (region->modEnvToPitch || region->modEnvToFilterFc) tsf_voice_envelope_process(&v->modenv, blockSamples, f->outSampleRate);
+	if (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume)) tsf_voice_lfo_process(&v->modlfo, blockSamples);
+	if (v->viblfo.delta && region->vibLfoToPitch) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+
+	f->laneVoices[i] = v;
+	l->input[i] = (v->samples ? v->samples : f->fontSamples);
+	l->base[i] = (v->samples ? v->samplesStart : 0);
+	l->loopStart[i] = v->loopStart;
+	l->loopEnd[i] = v->loopEnd;
+	l->position[i] = v->sourceSamplePosition;
+	l->pitchRatio[i] = pitchRatio;
+	l->end[i] = (double)region->end;
+	if (v->lowpass.active)
+		l->a0[i] = v->lowpass.a0, l->a1[i] = v->lowpass.a1, l->b1[i] = v->lowpass.b1, l->b2[i] = v->lowpass.b2, l->z1[i] = v->lowpass.z1, l->z2[i] = v->lowpass.z2;
+	else
+		l->a0[i] = 1, l->a1[i] = 0, l->b1[i] = 0, l->b2[i] = 0, l->z1[i] = 0, l->z2[i] = 0;
+	l->gainLeft[i] = gainMono * v->panFactorLeft;
+	l->gainRight[i] = gainMono * v->panFactorRight;
+}
+
+static void tsf_render_lanes(tsf* f, float* buffer, int samples)
+{
+	struct tsf_voice *v, *vEnd = f->voices + f->voiceNum;
+	int i, blockSamples;
+	for (; samples; samples -= blockSamples, buffer += 2 * blockSamples)
+	{
+		blockSamples = (samples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : samples);
+		f->lanes.count = 0;
+		for (v = f->voices; v != vEnd; v++)
+			if (v->playingPreset != -1)
+				tsf_voice_lane(f, v, blockSamples);
+		if (!f->lanes.count) continue;
+
+		f->lanesRenderer(&f->lanes, buffer, blockSamples);
+		for (i = 0; i != f->lanes.count; i++)
+		{
+			v = f->laneVoices[i];
+			v->sourceSamplePosition = f->lanes.position[i];
+			if (v->lowpass.active)
+			{
+				v->lowpass.z1 = f->lanes.z1[i], v->lowpass.z2 = f->lanes.z2[i];
+				tsf_voice_lowpass_flush(&v->lowpass);
+			}
+			if (v->sourceSamplePosition >= f->lanes.end[i] || v->ampenv.segment == TSF_SEGMENT_DONE)
+				tsf_voice_kill(f, v);
+		}
+	}
+}
+
+TSFDEF void tsf_set_lanes_renderer(tsf* f, void (*render)(struct tsf_voice_lanes* lanes, float* buffer, int samples))
+{
+	f->lanesRenderer = render;
+}
+
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing)
 {
 	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
 	if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(float) * samples);
-	for (; v != vEnd; v++)
+	if (f->lanesRenderer && f->outputmode == TSF_STEREO_INTERLEAVED && tsf_lanes_reserve(f, f->voiceNum))
+		tsf_render_lanes(f, buffer, samples);
+	else for (; v != vEnd; v++)
 		if (v->playingPreset != -1)
 			tsf_voice_render(f, v, buffer, samples);
 }
@@ -1712,7 +1982,7 @@ TSFDEF int tsf_channel_get_preset_number(tsf* f, int channel)
 
 TSFDEF float tsf_channel_get_pan(tsf* f, int channel)
 {
-	return (f->channels && channel < f->channels->channelNum ? f->channels->channels[channel].panOffset - 0.5f : 0.5f);
+	return (f->channels && channel < f->channels->channelNum ? f->channels->channels[channel].panOffset + 0.5f : 0.5f);
 }
 
 TSFDEF float tsf_channel_get_volume(tsf* f, int channel)
@@ -1,5 +1,7 @@
 #pragma once
+#include <assert.h>
 #include <initializer_list>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -19,6 +21,20 @@
 #endif
 #endif
 
+static inline int count_trailing_zeros(uint64_t v) {
+  assert(v != 0);
+#ifdef __GNUC__
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
 struct Terminal;
 struct Input;
 
@@ -5,6 +5,7 @@
 
 static System *musigrid = nullptr;
 static uint8_t *video_buf;
+static int16_t audio_buf[Machine::AUDIO_SAMPLES];
 static retro_environment_t env_cb;
 static retro_video_refresh_t video_cb;
 static retro_audio_sample_batch_t audio_cb;
@@ -114,10 +115,10 @@ RETRO_API void retro_run(void) {
 
   musigrid->handle_input(input);
 
-  musigrid->machine.run();
+  musigrid->run();
 
-  audio_cb(musigrid->machine.audio_samples.data(),
-           musigrid->machine.audio_samples.size() / 2);
+  musigrid->machine.audio_samples_s16(audio_buf);
+  audio_cb(audio_buf, Machine::AUDIO_SAMPLES / 2);
 
   musigrid->draw();
   musigrid->term.draw_buffer(video_buf, 640 * sizeof(uint32_t));
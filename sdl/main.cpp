@@ -121,13 +121,14 @@ SDL_AudioDeviceID audio_dev;
 struct {
   std::mutex mut;
   std::condition_variable read_cv, write_cv;
-  CircularBuffer<uint8_t> buffer;
+  CircularBuffer<float> buffer;
   int notes = 0;
   bool quit = false;
 } audio;
 
-static void audio_callback(void *, uint8_t *data, int len) {
-  size_t size = len;
+static void audio_callback(void *, uint8_t *bytes, int len) {
+  auto data = (float *)bytes;
+  size_t size = len / sizeof(float);
 
   std::unique_lock<std::mutex> lk(audio.mut);
   audio.read_cv.wait(lk,
@@ -143,7 +144,7 @@ static void audio_callback(void *, uint8_t *data, int len) {
   }
 
   if (size)
-    fprintf(stderr, "buffer underrun: %zu unused bytes\n", size);
+    fprintf(stderr, "buffer underrun: %zu unused samples\n", size);
 
 zero_buffer:
   lk.unlock();
@@ -151,7 +152,7 @@ zero_buffer:
   std::fill(data, data + size, 0);
 }
 
-static void audio_write(uint8_t *data, size_t size) {
+static void audio_write(const float *data, size_t size) {
 
   while (size) {
     std::unique_lock<std::mutex> lk(audio.mut);
@@ -186,14 +187,14 @@ int main(int, char *[]) {
   SDL_AudioSpec spec;
   spec.channels = 2;
   spec.freq = Machine::AUDIO_SAMPLE_RATE;
-  spec.format = AUDIO_S16;
+  spec.format = AUDIO_F32SYS;
   spec.samples = system.machine.audio_samples.size() / 2;
   spec.callback = audio_callback;
 
   audio_dev = SDL_OpenAudioDevice(NULL, false, &spec, &spec, 0);
   SDL_PauseAudioDevice(audio_dev, 0);
 
-  audio.buffer.storage.resize(spec.size);
+  audio.buffer.storage.resize(spec.size / sizeof(float));
 
   bool running = true;
 
@@ -221,10 +222,10 @@ int main(int, char *[]) {
 
     system.handle_input(input);
 
-    system.machine.run();
+    system.run();
 
-    audio_write((uint8_t *)system.machine.audio_samples.data(),
-                system.machine.audio_samples.size() * sizeof(int16_t));
+    audio_write(system.machine.audio_samples.data(),
+                system.machine.audio_samples.size());
 
     system.draw();
 
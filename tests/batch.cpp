@@ -0,0 +1,130 @@
+#include "../core/batch.hpp"
+#include "../core/machine.hpp"
+#include "../core/pool.hpp"
+#include "../core/tsf.h"
+#include <gtest/gtest.h>
+#include <string>
+
+static const char NOTES_PATCH[] = "................\n"
+                                  ".#.batch.#......\n"
+                                  "...wC4..........\n"
+                                  ".gD204TCAFE.....\n"
+                                  "...:02C.g.......\n"
+                                  "...8C4..........\n"
+                                  ".4D234TCAFE.....\n"
+                                  "...%13E.4.......\n"
+                                  ".2I6..1AC..3M4..\n"
+                                  "...........aV...\n";
+
+static std::string dump(unsigned tick, const ChangeSet::NoteEvent &event) {
+  return std::to_string(tick) + (event.on ? " on " : " off ") +
+         std::to_string(event.note.channel) + " " +
+         std::to_string(event.note.key) + "\n";
+}
+
+// The notes tick() reports in changes, one tick at a time.
+static std::string tick_one_by_one(unsigned n) {
+  Machine m;
+  m.load_string(NOTES_PATCH);
+  m.track_changes = true;
+
+  std::string out;
+  for (unsigned t = 0; t < n; ++t) {
+    m.tick<HeadlessTick>();
+    for (auto &event : m.changes.notes)
+      out += dump(m.ticks, event);
+  }
+  return out;
+}
+
+TEST(tick_n, streams_the_notes) {
+  Machine m;
+  m.load_string(NOTES_PATCH);
+
+  std::string out;
+  m.tick_n(1000, [&](unsigned tick, const ChangeSet::NoteEvent &event) {
+    out += dump(tick, event);
+  });
+
+  EXPECT_EQ(out, tick_one_by_one(1000));
+  EXPECT_EQ(m.ticks, 1000u);
+
+  // none of them reached the synth
+  EXPECT_EQ(tsf_active_voice_count(m.sf), 0);
+  EXPECT_TRUE(m.synthesize);
+  EXPECT_TRUE(m.note_events.empty());
+}
+
+TEST(tick_n, fast_forwards_periods) {
+  Machine m;
+  m.load_string(NOTES_PATCH);
+  m.find_cycles = true;
+
+  std::string out;
+  auto sink = [&](unsigned tick, const ChangeSet::NoteEvent &event) {
+    out += dump(tick, event);
+  };
+
+  // in steps that do not line up with the period
+  for (int i = 0; i < 10; ++i)
+    m.tick_n(397, sink);
+
+  EXPECT_NE(m.cycles.period, 0u);
+  EXPECT_EQ(out, tick_one_by_one(3970));
+}
+
+// What each job rendered, the audio as a hash.
+struct Rendered {
+  std::string notes;
+  uint64_t audio = 0;
+  size_t frames = 0;
+};
+
+static std::vector<Rendered> render(int threads, bool audio) {
+  // the second one plays random octaves, every tick
+  const char *patches[] = {NOTES_PATCH, "D12R5\n.:0.C\n", "...\n.aV4\n"};
+
+  std::vector<Rendered> out(12);
+  std::vector<BatchJob> jobs(out.size());
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    auto &rendered = out[i];
+    jobs[i].patch = patches[i % 3];
+    jobs[i].ticks = 100 + i;
+    jobs[i].on_note = [&rendered](unsigned tick,
+                                  const ChangeSet::NoteEvent &event) {
+      rendered.notes += dump(tick, event);
+    };
+    if (audio)
+      jobs[i].on_audio = [&rendered](const int16_t *samples, size_t frames) {
+        for (size_t s = 0; s < 2 * frames; ++s)
+          rendered.audio = zobrist_key(rendered.audio ^ (uint16_t)samples[s]);
+        rendered.frames += frames;
+      };
+  }
+
+  ThreadPool pool(threads);
+  auto stats = render_batch(pool, jobs);
+
+  EXPECT_EQ(stats.ticks, 12 * 100u + 66);
+  EXPECT_EQ(stats.frames, audio ? (12 * 100u + 66) * 8 * 735 : 0);
+  return out;
+}
+
+TEST(render_batch, same_on_any_thread_count) {
+  auto alone = render(1, true);
+  auto shared = render(4, true);
+
+  for (size_t i = 0; i < alone.size(); ++i) {
+    EXPECT_EQ(alone[i].notes, shared[i].notes) << "job " << i;
+    EXPECT_EQ(alone[i].audio, shared[i].audio) << "job " << i;
+    EXPECT_EQ(alone[i].frames, shared[i].frames) << "job " << i;
+  }
+
+  // the same as one machine ticking on its own
+  EXPECT_EQ(alone[0].notes, tick_one_by_one(100));
+  EXPECT_NE(alone[1].notes, "");
+
+  auto silent = render(4, false);
+  for (size_t i = 0; i < alone.size(); ++i)
+    EXPECT_EQ(alone[i].notes, silent[i].notes) << "job " << i;
+}
@@ -0,0 +1,101 @@
+#include "../core/machine.hpp"
+#include <gtest/gtest.h>
+
+static const ChangeSet::CellChange *find_cell(const ChangeSet &changes, int x,
+                                              int y) {
+  for (auto &cell : changes.cells)
+    if (cell.x == x && cell.y == y)
+      return &cell;
+  return nullptr;
+}
+
+static Machine tracked(const std::string &data) {
+  Machine m;
+  m.load_string(data);
+  m.track_changes = true;
+  return m;
+}
+
+TEST(change_set, first_tick_is_a_reset) {
+  auto m = tracked("..1\n"
+                   "...\n");
+  m.tick();
+
+  EXPECT_TRUE(m.changes.reset);
+  ASSERT_EQ(m.changes.cells.size(), 1u);
+  EXPECT_EQ(m.changes.cells[0].x, 2);
+  EXPECT_EQ(m.changes.cells[0].y, 0);
+  EXPECT_EQ(m.changes.cells[0].c, '1');
+  EXPECT_EQ(m.changes.cells[0].flags, CF_IS_LITERAL);
+
+  m.tick();
+  EXPECT_FALSE(m.changes.reset);
+  EXPECT_TRUE(m.changes.cells.empty());
+}
+
+TEST(change_set, only_changed_cells) {
+  auto m = tracked("C8..\n"
+                   "....\n");
+  m.tick();
+  m.tick();
+
+  // the clock output below it is the only glyph changing
+  ASSERT_EQ(m.changes.cells.size(), 1u);
+  EXPECT_EQ(m.changes.cells[0].x, 0);
+  EXPECT_EQ(m.changes.cells[0].y, 1);
+  EXPECT_EQ(m.changes.cells[0].c, '2');
+}
+
+TEST(change_set, edits_between_ticks) {
+  auto m = tracked("....\n"
+                   "....\n");
+  m.tick();
+
+  m.new_cell(3, 1, '7');
+  m.tick();
+  ASSERT_NE(find_cell(m.changes, 3, 1), nullptr);
+  EXPECT_EQ(find_cell(m.changes, 3, 1)->c, '7');
+
+  // the tile goes away with the last glyph, the deletion is still reported
+  m.new_cell(3, 1, '.');
+  m.tick();
+  ASSERT_NE(find_cell(m.changes, 3, 1), nullptr);
+  EXPECT_EQ(find_cell(m.changes, 3, 1)->c, '.');
+  EXPECT_TRUE(m.live_tiles.empty());
+}
+
+TEST(change_set, resize_is_a_reset) {
+  auto m = tracked("1.\n"
+                   "..\n");
+  m.tick();
+  m.set_size(40, 40);
+  m.tick();
+
+  EXPECT_TRUE(m.changes.reset);
+  ASSERT_EQ(m.changes.cells.size(), 1u);
+  EXPECT_EQ(m.changes.cells[0].c, '1');
+}
+
+TEST(change_set, note_events) {
+  auto m = tracked("*:12C41\n");
+  m.tick();
+
+  ASSERT_EQ(m.changes.notes.size(), 1u);
+  EXPECT_TRUE(m.changes.notes[0].on);
+  EXPECT_EQ(m.changes.notes[0].note.channel, 1);
+  EXPECT_EQ(m.changes.notes[0].note.key, note_octave0_to_key('C', 2));
+
+  m.tick();
+  ASSERT_EQ(m.changes.notes.size(), 1u);
+  EXPECT_FALSE(m.changes.notes[0].on);
+  EXPECT_EQ(m.changes.notes[0].note.key, note_octave0_to_key('C', 2));
+}
+
+TEST(change_set, untracked_ticks_report_nothing) {
+  Machine m;
+  m.load_string("*:12C41\n");
+  m.tick();
+
+  EXPECT_TRUE(m.changes.cells.empty());
+  EXPECT_TRUE(m.changes.notes.empty());
+}
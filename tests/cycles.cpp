@@ -0,0 +1,110 @@
+#include "../core/machine.hpp"
+#include "patches.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+static const char NOTES_PATCH[] = "................\n"
+                                  ".#.cycles.#.....\n"
+                                  "...wC4..........\n"
+                                  ".gD204TCAFE.....\n"
+                                  "...:02C.g.......\n"
+                                  "...8C4..........\n"
+                                  ".4D234TCAFE.....\n"
+                                  "...%13E.4.......\n"
+                                  ".2I6..1AC..3M4..\n"
+                                  "...........aV...\n";
+
+static std::string dump_notes(const Machine &m) {
+  std::string out;
+  for (auto &event : m.changes.notes)
+    out += std::string(event.on ? "on " : "off ") +
+           std::to_string(event.note.channel) + " " +
+           std::to_string(event.note.key) + "\n";
+  return out;
+}
+
+TEST(cycles, finds_the_period) {
+  Machine m;
+  m.load_string(NOTES_PATCH);
+  m.find_cycles = true;
+
+  for (int t = 0; t < 1000 && !m.cycles.period; ++t)
+    m.tick<HeadlessTick>();
+
+  // wC4 comes back every 128 ticks and 2I6 every 3, the state after the
+  // first tick is the first to repeat
+  EXPECT_EQ(m.cycles.period, 384u);
+  EXPECT_EQ(m.ticks, 385u);
+}
+
+TEST(cycles, random_numbers_never_repeat) {
+  Machine m;
+  m.load_string("2R3\n"
+                "...\n");
+  m.find_cycles = true;
+
+  for (int t = 0; t < 300; ++t)
+    m.tick<HeadlessTick>();
+
+  EXPECT_EQ(m.cycles.period, 0u);
+  EXPECT_EQ(m.fast_forward(100, [] {}), 0u);
+}
+
+// Renders the same number of ticks with and without fast_forward(), the
+// notes must match tick by tick.
+TEST(cycles, fast_forward_plays_the_same_notes) {
+  Machine ticked, skipped;
+  ticked.load_string(NOTES_PATCH);
+  skipped.load_string(NOTES_PATCH);
+  ticked.track_changes = skipped.track_changes = true;
+  skipped.find_cycles = true;
+
+  std::vector<std::string> expected, got;
+  for (int t = 0; t < 2000; ++t) {
+    ticked.tick<HeadlessTick>();
+    expected.push_back(dump_notes(ticked));
+  }
+
+  unsigned fast = 0;
+  while (got.size() < expected.size()) {
+    fast += skipped.fast_forward(expected.size() - got.size(),
+                                 [&] { got.push_back(dump_notes(skipped)); });
+    if (got.size() < expected.size()) {
+      skipped.tick<HeadlessTick>();
+      got.push_back(dump_notes(skipped));
+    }
+  }
+
+  EXPECT_GT(fast, 1500u);
+  for (size_t t = 0; t < expected.size(); ++t)
+    ASSERT_EQ(expected[t], got[t]) << "tick " << t;
+
+  EXPECT_EQ(skipped.ticks, ticked.ticks);
+  EXPECT_EQ(skipped.to_string(), ticked.to_string());
+  EXPECT_EQ(skipped.state_hash(), ticked.state_hash());
+  EXPECT_EQ(dump_playing(skipped), dump_playing(ticked));
+
+  // both go on the same from there
+  for (int t = 0; t < 100; ++t) {
+    ticked.tick<HeadlessTick>();
+    skipped.tick<HeadlessTick>();
+    ASSERT_EQ(dump_notes(skipped), dump_notes(ticked)) << "tick " << t;
+  }
+}
+
+TEST(cycles, edits_start_over) {
+  Machine m;
+  m.load_string(NOTES_PATCH);
+  m.find_cycles = true;
+
+  for (int t = 0; t < 400; ++t)
+    m.tick<HeadlessTick>();
+  ASSERT_NE(m.cycles.period, 0u);
+
+  m.new_cell(14, 0, '1');
+  EXPECT_EQ(m.fast_forward(1000, [] {}), 0u);
+
+  m.tick<HeadlessTick>();
+  EXPECT_EQ(m.cycles.period, 0u);
+  EXPECT_EQ(m.cycles.count, 1u);
+}
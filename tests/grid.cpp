@@ -0,0 +1,68 @@
+#include "../core/machine.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(grid, sparse_canvas_allocates_few_tiles) {
+  Machine m;
+  m.set_size(4096, 4096);
+  EXPECT_TRUE(m.live_tiles.empty());
+
+  m.new_cell(10, 10, 'D');
+  m.new_cell(4000, 3000, 'D');
+  EXPECT_EQ(m.live_tiles.size(), 2u);
+
+  m.tick();
+  EXPECT_EQ(m.peek_cell(10, 11), '*');
+  EXPECT_EQ(m.peek_cell(4000, 3001), '*');
+  EXPECT_EQ(m.peek_cell(2000, 2000), '.');
+}
+
+TEST(grid, empty_tiles_are_recycled) {
+  Machine m;
+  m.set_size(256, 256);
+  m.new_cell(100, 100, 'A');
+  m.new_cell(100, 100, '.');
+  m.tick();
+  m.tick();
+  EXPECT_TRUE(m.live_tiles.empty());
+}
+
+TEST(grid, operator_across_tile_edge) {
+  Machine m;
+  m.set_size(64, 64);
+  // A at x = 31 reads 30 and 32 and writes below, straddling two tiles.
+  m.new_cell(30, 5, '3');
+  m.new_cell(31, 5, 'A');
+  m.new_cell(32, 5, '4');
+  m.tick();
+  EXPECT_EQ(m.peek_cell(31, 6), '7');
+
+  m.new_cell(31, 31, 'E');
+  m.tick();
+  EXPECT_EQ(m.peek_cell(32, 31), 'E');
+  EXPECT_EQ(m.peek_cell(31, 31), '.');
+}
+
+TEST(grid, resize_keeps_cells) {
+  Machine m;
+  m.load_string("1..\n.A.\n..Z\n");
+  m.set_size(100, 70);
+  EXPECT_EQ(m.peek_cell(0, 0), '1');
+  EXPECT_EQ(m.peek_cell(1, 1), 'A');
+  EXPECT_EQ(m.peek_cell(2, 2), 'Z');
+
+  m.set_size(2, 2);
+  EXPECT_EQ(m.to_string(), "1.\n.A\n");
+}
+
+TEST(grid, describe_cells) {
+  Machine m;
+  m.load_string("1A2\n...\n");
+  EXPECT_EQ(m.describe(1, 0), "empty");
+
+  m.tick();
+  EXPECT_EQ(m.describe(1, 0), "add");
+  EXPECT_EQ(m.describe(0, 0), "A-a");
+  EXPECT_EQ(m.describe(1, 1), "A-output");
+  EXPECT_EQ(m.describe(2, 1), "empty");
+}
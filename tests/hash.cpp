@@ -0,0 +1,106 @@
+#include "../core/machine.hpp"
+#include "../core/pool.hpp"
+#include "patches.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(hash, same_grid_same_hash) {
+  Machine loaded, edited;
+  loaded.load_string(".1A2.\n"
+                     "..V..\n");
+
+  edited.set_size(5, 2);
+  edited.new_cell(0, 0, 'X');
+  edited.new_cell(1, 0, '1');
+  edited.new_cell(2, 0, 'A');
+  edited.new_cell(3, 0, '2');
+  edited.new_cell(2, 1, 'V');
+  EXPECT_NE(loaded.state_hash(), edited.state_hash());
+
+  edited.new_cell(0, 0, '.');
+  EXPECT_EQ(loaded.state_hash(), edited.state_hash());
+
+  edited.variables.set('a', '3');
+  EXPECT_NE(loaded.state_hash(), edited.state_hash());
+  edited.variables.set('a', '.');
+  EXPECT_EQ(loaded.state_hash(), edited.state_hash());
+
+  // the cells that fit are carried over
+  edited.set_size(3, 2);
+  EXPECT_EQ(edited.state_hash(), edited.full_state_hash());
+  edited.set_size(5, 2);
+  EXPECT_NE(loaded.state_hash(), edited.state_hash());
+}
+
+TEST(hash, clock_phase) {
+  Machine m;
+  m.load_string("2C2\n"
+                "...\n");
+
+  // the output counts every other tick: 1, 1, 0, 0, 1, ...
+  std::vector<uint64_t> hashes;
+  for (int t = 0; t < 5; ++t) {
+    m.tick();
+    hashes.push_back(m.state_hash());
+  }
+
+  EXPECT_EQ(m.clock_period, 2u);
+  EXPECT_NE(hashes[0], hashes[1]);
+  EXPECT_NE(hashes[0], hashes[2]);
+  EXPECT_EQ(hashes[0], hashes[4]);
+
+  m.new_cell(0, 1, 'R');
+  m.tick();
+  EXPECT_EQ(m.clock_period, 0u);
+}
+
+// Ticks random patches, edited between ticks, serially and on regions, and
+// checks the hashes against one computed from scratch.
+TEST(hash, kept_up_to_date) {
+  ThreadPool pool(4);
+  Rng rng(3);
+  unsigned region_ticks = 0;
+
+  for (int n = 0; n < 600; ++n) {
+    // blocks scattered over an empty grid, so it splits into regions
+    int w = 8 + rng.next(200), h = 4 + rng.next(120);
+    std::string patch((w + 1) * h, '.');
+    for (int y = 0; y < h; ++y)
+      patch[y * (w + 1) + w] = '\n';
+
+    for (int blocks = 1 + rng.next(6); blocks > 0; --blocks) {
+      int bw = 1 + rng.next(16), bh = 1 + rng.next(8);
+      int bx = rng.next(w), by = rng.next(h);
+      for (int y = by; y < std::min(by + bh, h); ++y)
+        for (int x = bx; x < std::min(bx + bw, w); ++x)
+          patch[y * (w + 1) + x] = rng.glyph();
+    }
+
+    Machine serial, parallel;
+    serial.load_string(patch);
+    parallel.load_string(patch);
+    parallel.pool = &pool;
+
+    for (int t = 0; t < 20; ++t) {
+      if (rng.next(4) == 0) {
+        int x = rng.next(w), y = rng.next(h);
+        char c = rng.glyph();
+        serial.new_cell(x, y, c);
+        parallel.new_cell(x, y, c);
+      }
+
+      serial.tick<HeadlessTick>();
+      parallel.tick<HeadlessTick>();
+      ASSERT_EQ(serial.state_hash(), serial.full_state_hash())
+          << "patch " << n << ", tick " << t << "\n"
+          << patch;
+      ASSERT_EQ(parallel.state_hash(), serial.state_hash())
+          << "patch " << n << ", tick " << t << "\n"
+          << patch;
+    }
+
+    region_ticks += parallel.region_ticks;
+  }
+
+  EXPECT_GT(region_ticks, 0u);
+}
@@ -0,0 +1,68 @@
+#include "../core/notes.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+static Note make_note(int channel, int key, int length) {
+  Note n;
+  n.channel = channel;
+  n.key = key;
+  n.velocity = 1.0f;
+  n.length = length;
+  return n;
+}
+
+TEST(note_schedule, ends_after_length) {
+  NoteSchedule notes;
+  std::vector<int> ended;
+  auto note_off = [&](const Note &note) { ended.push_back(note.key); };
+
+  notes.add(make_note(0, 60, 3));
+  notes.add(make_note(1, 61, 0)); // still lasts a tick
+  notes.add(make_note(2, 62, 1));
+  EXPECT_EQ(notes.front().length, 3);
+
+  notes.advance(note_off);
+  EXPECT_EQ(ended, std::vector<int>({61, 62}));
+  EXPECT_EQ(notes.size(), 1u);
+  EXPECT_EQ(notes.front().length, 2);
+
+  notes.advance(note_off);
+  EXPECT_EQ(notes.size(), 1u);
+
+  notes.advance(note_off);
+  EXPECT_EQ(ended, std::vector<int>({61, 62, 60}));
+  EXPECT_TRUE(notes.empty());
+}
+
+TEST(note_schedule, cut_channel) {
+  NoteSchedule notes;
+  std::vector<int> ended;
+  auto note_off = [&](const Note &note) { ended.push_back(note.key); };
+
+  notes.add(make_note(3, 60, 5));
+  notes.add(make_note(4, 61, 5));
+  notes.add(make_note(3, 62, 2));
+
+  notes.cut_channel(3, note_off);
+  EXPECT_EQ(ended, std::vector<int>({60, 62}));
+  EXPECT_EQ(notes.size(), 1u);
+  EXPECT_EQ(notes.front().key, 61);
+
+  // the wheel no longer holds the cut notes
+  notes.advance(note_off);
+  notes.advance(note_off);
+  EXPECT_EQ(ended.size(), 2u);
+}
+
+TEST(note_schedule, reuses_slots) {
+  NoteSchedule notes;
+  auto note_off = [](const Note &) {};
+
+  for (int tick = 0; tick < 1000; ++tick) {
+    for (int i = 0; i < 10; ++i)
+      notes.add(make_note(i, tick % 128, 1 + i));
+    notes.advance(note_off);
+  }
+
+  EXPECT_EQ(notes.slots.size(), notes.size() + 10);
+}
@@ -616,7 +616,7 @@ TEST(operator_k, one_var) {
                "....\n";
 
   c.create();
-  c.m->variables['a'] = 'Z';
+  c.m->variables.set('a', 'Z');
 
   EXPECT_TRUE(c.output_matches());
 }
@@ -634,8 +634,8 @@ TEST(operator_k, two_vars) {
                "....\n";
 
   c.create();
-  c.m->variables['a'] = 'Z';
-  c.m->variables['x'] = 'C';
+  c.m->variables.set('a', 'Z');
+  c.m->variables.set('x', 'C');
 
   EXPECT_TRUE(c.output_matches());
 }
@@ -653,8 +653,8 @@ TEST(operator_k, two_vars_len2) {
                "....\n";
 
   c.create();
-  c.m->variables['a'] = 'Z';
-  c.m->variables['x'] = 'C';
+  c.m->variables.set('a', 'Z');
+  c.m->variables.set('x', 'C');
 
   EXPECT_TRUE(c.output_matches());
 }
@@ -1079,6 +1079,19 @@ TEST(operator_v, write) {
   EXPECT_TRUE(c.m->variables.at('a') == '1');
 }
 
+TEST(operator_v, reset_clears) {
+  OutputCompare c;
+  c.input = ".....\n"
+            ".aV1.\n"
+            ".....\n"
+            ".....";
+
+  c.create_and_tick();
+  c.m->reset();
+
+  EXPECT_TRUE(c.m->variables.at('a') == '.');
+}
+
 TEST(operator_v, read) {
   OutputCompare c;
   c.input = ".....\n"
@@ -1336,6 +1349,14 @@ TEST(operator_midi, banged_full) {
   EXPECT_EQ(note.length, 5);
 }
 
+TEST(operator_midi, transposed_letters) {
+  EXPECT_EQ(note_octave0_to_key('H', 3), note_octave0_to_key('A', 4));
+  EXPECT_EQ(note_octave0_to_key('I', 3), note_octave0_to_key('B', 4));
+  EXPECT_EQ(note_octave0_to_key('j', 3), note_octave0_to_key('c', 4));
+  EXPECT_EQ(note_octave0_to_key('Z', 0), note_octave0_to_key('E', 3));
+  EXPECT_EQ(note_octave0_to_key('.', 0), -1);
+}
+
 TEST(operator_mono, empty) {
   OutputCompare c;
   c.input = "%.....";
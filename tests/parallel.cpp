@@ -0,0 +1,140 @@
+#include "../core/machine.hpp"
+#include "../core/pool.hpp"
+#include "patches.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+// without the long reaching operators and those using shared state, which
+// tend to merge everything in a single region
+static const char NEAR_GLYPHS[] = "0123456789ABCDEFHIJLMNSWYZ"
+                                  "abcdefhijlmnswyz*#:%";
+
+struct PatchGenerator : Rng {
+  PatchGenerator() : Rng(1) {}
+
+  // Random blocks scattered over an empty grid, so there are several regions
+  // and operators near their edges.
+  std::string patch() {
+    int w = 8 + next(250);
+    int h = 4 + next(150);
+    int density = 1 + next(4);
+    bool near = next(2);
+    std::string grid((w + 1) * h, '.');
+
+    for (int y = 0; y < h; ++y)
+      grid[y * (w + 1) + w] = '\n';
+
+    for (int blocks = 1 + next(8); blocks > 0; --blocks) {
+      int bw = 1 + next(20), bh = 1 + next(10);
+      int bx = next(w), by = next(h);
+
+      for (int y = by; y < std::min(by + bh, h); ++y)
+        for (int x = bx; x < std::min(bx + bw, w); ++x)
+          if (next(density) == 0)
+            grid[y * (w + 1) + x] =
+                near ? NEAR_GLYPHS[next(sizeof(NEAR_GLYPHS) - 1)]
+                     : GLYPHS[next(sizeof(GLYPHS) - 1)];
+    }
+
+    return grid;
+  }
+};
+
+// The first cell whose glyph, flags or descriptor differ, "" if none.
+static std::string first_difference(const Machine &a, const Machine &b) {
+  for (int y = 0; y < a.grid_h(); ++y) {
+    for (int x = 0; x < a.grid_w(); ++x) {
+      auto i = a.cell_index(x, y);
+      auto &ta = a.tile(i), &tb = b.tile(i);
+      auto offset = a.tile_offset(i);
+      auto flags = ta.flags[offset];
+
+      if (ta.glyphs[offset] != tb.glyphs[offset] ||
+          flags != tb.flags[offset] ||
+          ((flags & CF_HAS_DESC) && a.desc_at(i) != b.desc_at(i)))
+        return std::to_string(x) + ", " + std::to_string(y);
+    }
+  }
+  return "";
+}
+
+static std::string dump_notes(const Machine &m) {
+  std::string out = dump_playing(m);
+  for (auto &event : m.changes.notes)
+    out += std::string(event.on ? "on " : "off ") +
+           std::to_string(event.note.key) + "\n";
+
+  for (auto &value : m.variables.values)
+    out += value;
+
+  return out;
+}
+
+template <typename Policy> static void tick_both(Machine &a, Machine &b) {
+  a.tick<Policy>();
+  b.tick<Policy>();
+}
+
+TEST(parallel_tick, same_as_serial) {
+  ThreadPool pool(4);
+  PatchGenerator gen;
+  unsigned ticks = 0, region_ticks = 0;
+
+  for (int n = 0; n < 2000; ++n) {
+    auto patch = gen.patch();
+
+    Machine serial, parallel;
+    serial.load_string(patch);
+    parallel.load_string(patch);
+    serial.track_changes = parallel.track_changes = true;
+    parallel.pool = &pool;
+
+    for (int t = 0; t < 24; ++t) {
+      if (n % 2)
+        tick_both<AnnotatedTick>(serial, parallel);
+      else
+        tick_both<HeadlessTick>(serial, parallel);
+
+      ASSERT_EQ(first_difference(serial, parallel), "")
+          << "patch " << n << ", tick " << t << "\n"
+          << patch;
+      ASSERT_EQ(dump_notes(serial), dump_notes(parallel))
+          << "patch " << n << ", tick " << t;
+    }
+
+    ticks += 24;
+    region_ticks += parallel.region_ticks;
+  }
+
+  // most of the patches do split into regions
+  EXPECT_GT(region_ticks, ticks / 4);
+}
+
+TEST(parallel_tick, rolls_back_escapes) {
+  ThreadPool pool(2);
+
+  // G copies "90X*" 35 cells away, the '*' then bangs the X it lands next to
+  // and that X reaches further than anything G's region was made of
+  std::string row0 = "z0zG" + std::string(31, '.') + "90X*";
+  row0 += std::string(250 - row0.size(), '.') + "C8";
+  row0 += std::string(300 - row0.size(), '.');
+
+  std::string patch = row0 + "\n";
+  for (int y = 1; y < 40; ++y)
+    patch += std::string(300, '.') + "\n";
+
+  Machine serial, parallel;
+  serial.load_string(patch);
+  parallel.load_string(patch);
+  parallel.pool = &pool;
+
+  for (int t = 0; t < 8; ++t) {
+    serial.tick();
+    parallel.tick();
+    ASSERT_EQ(serial.to_string(), parallel.to_string()) << "tick " << t;
+  }
+
+  // once there the X is part of the region, after one tick of back-off
+  EXPECT_EQ(serial.peek_cell(71, 1), 'X');
+  EXPECT_EQ(parallel.region_ticks, 6u);
+}
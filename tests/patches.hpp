@@ -0,0 +1,39 @@
+#pragma once
+#include "../core/machine.hpp"
+#include <stdint.h>
+#include <string>
+
+// Every operator, plus a few glyphs for their values.
+static const char GLYPHS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                             "abcdefghijklmnopqrstuvwxyz*#:%";
+
+// Reproducible random numbers for the generated patches, each test seeding
+// its own.
+struct Rng {
+  uint64_t state;
+
+  explicit Rng(uint64_t seed) : state(seed) {}
+
+  unsigned next(unsigned n) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(state >> 33) % n;
+  }
+
+  // '.' for ten draws in 76, one of GLYPHS otherwise
+  char glyph() {
+    auto n = next(10 + sizeof(GLYPHS) - 1);
+    return n < 10 ? '.' : GLYPHS[n - 10];
+  }
+};
+
+// The notes still playing, in the order the machine keeps them.
+static inline std::string dump_playing(const Machine &m) {
+  std::string out;
+  for (auto i = m.notes.order.head; i != NoteSchedule::NIL;
+       i = m.notes.slots[i].order.next) {
+    auto note = m.notes.remaining(i);
+    out += std::to_string(note.channel) + " " + std::to_string(note.key) +
+           " " + std::to_string(note.length) + "\n";
+  }
+  return out;
+}
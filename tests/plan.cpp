@@ -0,0 +1,90 @@
+#include "../core/machine.hpp"
+#include "patches.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+static std::string dump(const Machine &m) {
+  return m.to_string() + dump_playing(m);
+}
+
+TEST(plan, kept_while_operators_stay) {
+  Machine m;
+  m.load_string("..........\n"
+                ".2C8..1A2.\n"
+                "..........\n"
+                ".1A2..3M2.\n");
+
+  m.tick();
+  EXPECT_TRUE(m.plan_valid);
+  EXPECT_EQ(m.plan.size(), 4u);
+
+  m.tick();
+  EXPECT_TRUE(m.plan_valid);
+  EXPECT_EQ(m.plan[0].x, 2);
+  EXPECT_EQ(m.plan[0].y, 1);
+
+  // a glyph for another operator leaves the operator cells as they were
+  m.new_cell(2, 1, 'I');
+  EXPECT_TRUE(m.plan_valid);
+
+  m.new_cell(8, 3, 'B');
+  EXPECT_FALSE(m.plan_valid);
+  m.tick();
+  EXPECT_TRUE(m.plan_valid);
+  EXPECT_EQ(m.plan.size(), 5u);
+}
+
+TEST(plan, movers_drop_it) {
+  Machine m;
+  m.load_string("E.........\n"
+                "..........\n");
+
+  m.tick();
+  EXPECT_FALSE(m.plan_valid);
+  EXPECT_EQ(m.peek_cell(1, 0), 'E');
+
+  m.tick();
+  EXPECT_EQ(m.peek_cell(2, 0), 'E');
+}
+
+// Ticks random patches, edited between ticks, with and without the plan.
+TEST(plan, same_as_scan) {
+  Rng rng(7);
+
+  for (int n = 0; n < 1000; ++n) {
+    int w = 3 + rng.next(40), h = 3 + rng.next(30);
+    std::string patch;
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x)
+        patch += rng.next(3) ? '.' : rng.glyph();
+      patch += '\n';
+    }
+
+    Machine planned, scanned;
+    planned.load_string(patch);
+    scanned.load_string(patch);
+
+    for (int t = 0; t < 30; ++t) {
+      for (int edits = rng.next(4) == 0 ? 1 + rng.next(3) : 0; edits > 0;
+           --edits) {
+        int x = rng.next(w), y = rng.next(h);
+        char c = rng.glyph();
+        planned.new_cell(x, y, c);
+        scanned.new_cell(x, y, c);
+      }
+
+      scanned.plan_valid = false;
+      if (t % 2) {
+        planned.tick<AnnotatedTick>();
+        scanned.tick<AnnotatedTick>();
+      } else {
+        planned.tick<HeadlessTick>();
+        scanned.tick<HeadlessTick>();
+      }
+
+      ASSERT_EQ(dump(planned), dump(scanned))
+          << "patch " << n << ", tick " << t << "\n"
+          << patch;
+    }
+  }
+}
@@ -0,0 +1,150 @@
+#include "../core/machine.hpp"
+#include "patches.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+// operators whose outputs only depend on nearby cells, and values for them
+static const char PURE[] = "0123456789ABFHJLMYabfhjlmy#:0123456789";
+
+static std::string dump(const Machine &m) {
+  std::string out;
+  for (int y = 0; y < m.grid_h(); ++y) {
+    for (int x = 0; x < m.grid_w(); ++x) {
+      auto cell = m.get_cell(x, y);
+      out += cell.c;
+      out += std::to_string(cell.flags);
+    }
+    out += '\n';
+  }
+  return out + dump_playing(m);
+}
+
+// Ticks every tile, as if all of them had just been edited.
+template <typename Policy = AnnotatedTick> static void tick_all(Machine &m) {
+  for (auto slot : m.live_tiles)
+    m.tile_store[m.tile_ids[slot]].edited = true;
+  m.tick<Policy>();
+}
+
+TEST(quiet, static_tiles_are_skipped) {
+  Machine m, all;
+  auto put = [&](int x, int y, const char *s) {
+    for (; *s; ++s, ++x) {
+      m.new_cell(x, y, *s);
+      all.new_cell(x, y, *s);
+    }
+  };
+
+  m.set_size(64, 32);
+  all.set_size(64, 32);
+  put(4, 4, "1A2");
+  put(4, 6, "3M4");
+  put(40, 4, "2C8");
+
+  // the first tick writes the outputs, the second sees nothing change
+  for (int t = 0; t < 3; ++t) {
+    m.tick();
+    tick_all(all);
+    ASSERT_EQ(dump(m), dump(all)) << "tick " << t;
+  }
+  EXPECT_EQ(m.quiet_tiles, 1u);
+
+  put(6, 4, "5");
+  m.tick();
+  tick_all(all);
+  EXPECT_EQ(m.quiet_tiles, 0u);
+  EXPECT_EQ(m.peek_cell(5, 5), '6');
+  EXPECT_EQ(dump(m), dump(all));
+}
+
+TEST(quiet, woken_when_reached) {
+  Machine m, all;
+  auto put = [&](int x, int y, const char *s) {
+    for (; *s; ++s, ++x) {
+      m.new_cell(x, y, *s);
+      all.new_cell(x, y, *s);
+    }
+  };
+
+  m.set_size(64, 32);
+  all.set_size(64, 32);
+
+  // every fourth tick D bangs the g, which then reads across the tile edge
+  // and locks the A of a quiet tile before the scan gets to it
+  put(39, 11, "1A2");
+  put(28, 10, "1D4");
+  put(25, 11, "00cg");
+
+  unsigned quiet = 0;
+  for (int t = 0; t < 12; ++t) {
+    m.tick();
+    tick_all(all);
+    quiet += m.quiet_tiles;
+    ASSERT_EQ(dump(m), dump(all)) << "tick " << t;
+  }
+
+  EXPECT_GT(quiet, 0u);
+}
+
+// Random blocks of mostly pure operators, about one per tile and edited
+// between ticks, ticked with and without skipping.
+TEST(quiet, same_as_ticking_everything) {
+  Rng rng(5);
+  unsigned quiet = 0;
+
+  for (int n = 0; n < 400; ++n) {
+    int w = 40 + rng.next(120), h = 34 + rng.next(60);
+    std::string patch((w + 1) * h, '.');
+    for (int y = 0; y < h; ++y)
+      patch[y * (w + 1) + w] = '\n';
+
+    for (int ty = 0; ty * TILE < h; ++ty) {
+      for (int tx = 0; tx * TILE < w; ++tx) {
+        if (rng.next(3) == 0)
+          continue;
+
+        // blocks up to the edges of their tile reach out of it
+        int margin = rng.next(4);
+        for (int y = ty * TILE + margin;
+             y < std::min(h, (ty + 1) * TILE - margin); ++y) {
+          for (int x = tx * TILE + margin;
+               x < std::min(w, (tx + 1) * TILE - margin); ++x) {
+            unsigned k = rng.next(100);
+            if (k < 75)
+              continue;
+            patch[y * (w + 1) + x] =
+                k < 99 ? PURE[rng.next(sizeof(PURE) - 1)]
+                       : GLYPHS[rng.next(sizeof(GLYPHS) - 1)];
+          }
+        }
+      }
+    }
+
+    Machine m, all;
+    m.load_string(patch);
+    all.load_string(patch);
+
+    for (int t = 0; t < 30; ++t) {
+      if (rng.next(5) == 0) {
+        int x = rng.next(w), y = rng.next(h);
+        char c = GLYPHS[rng.next(sizeof(GLYPHS) - 1)];
+        m.new_cell(x, y, c);
+        all.new_cell(x, y, c);
+      }
+
+      if (n % 2) {
+        m.tick<AnnotatedTick>();
+        tick_all<AnnotatedTick>(all);
+      } else {
+        m.tick<HeadlessTick>();
+        tick_all<HeadlessTick>(all);
+      }
+      quiet += m.quiet_tiles;
+
+      ASSERT_EQ(dump(m), dump(all)) << "patch " << n << ", tick " << t << "\n"
+                                    << patch;
+    }
+  }
+
+  EXPECT_GT(quiet, 0u);
+}
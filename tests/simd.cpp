@@ -0,0 +1,227 @@
+#include "../core/simd.hpp"
+#include "../core/tsf.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+static std::vector<char> all_bytes(size_t count) {
+  std::vector<char> out(count);
+  for (size_t i = 0; i < count; ++i)
+    out[i] = (char)(i * 7 + 3);
+  return out;
+}
+
+TEST(simd_flag_digits, matches_scalar) {
+  // odd sizes exercise the scalar tails of the vector kernels
+  for (size_t count : {0, 1, 15, 16, 17, 31, 33, 255, 1000}) {
+    auto glyphs = all_bytes(count);
+    std::vector<unsigned char> expected(count), result(count);
+
+    simd_flag_digits(SIMD_SCALAR, glyphs.data(), expected.data(), count, 1);
+
+    for (int level = SIMD_SCALAR; level <= simd_detect(); ++level) {
+      std::fill(result.begin(), result.end(), 0xff);
+      simd_flag_digits((SimdLevel)level, glyphs.data(), result.data(), count,
+                       1);
+      EXPECT_EQ(expected, result) << "level " << level << " count " << count;
+    }
+  }
+}
+
+TEST(simd_flag_digits, digits_only) {
+  const char glyphs[] = "0123456789.:/AZaz*#";
+  unsigned char flags[sizeof(glyphs) - 1];
+
+  simd_flag_digits(glyphs, flags, sizeof(flags), 4);
+
+  for (size_t i = 0; i < sizeof(flags); ++i)
+    EXPECT_EQ(flags[i], i < 10 ? 4 : 0) << glyphs[i];
+}
+
+// every float around the clamping thresholds and the limits, then a ramp
+// well past them both ways
+static std::vector<float> test_samples() {
+  std::vector<float> out;
+  for (float edge : {-1.00004566f, 1.00001514f, -1.f, 1.f, 0.f}) {
+    float v = edge;
+    for (int i = 0; i < 300; ++i)
+      v = nextafterf(v, -INFINITY);
+    for (int i = 0; i < 600; ++i, v = nextafterf(v, INFINITY))
+      out.push_back(v);
+  }
+
+  for (int i = -40000; i <= 40000; ++i)
+    out.push_back(i / 16384.f);
+  out.push_back(1e30f);
+  out.push_back(-1e30f);
+  return out;
+}
+
+TEST(simd_float_to_s16, matches_scalar) {
+  auto samples = test_samples();
+
+  for (size_t count : {(size_t)0, (size_t)1, (size_t)7, (size_t)17,
+                       (size_t)33, samples.size()}) {
+    std::vector<int16_t> expected(count), result(count);
+    simd_float_to_s16(SIMD_SCALAR, samples.data(), expected.data(), count);
+
+    for (int level = SIMD_SCALAR; level <= simd_detect(); ++level) {
+      std::fill(result.begin(), result.end(), 0x5555);
+      simd_float_to_s16((SimdLevel)level, samples.data(), result.data(),
+                        count);
+      EXPECT_EQ(expected, result) << "level " << level << " count " << count;
+    }
+  }
+}
+
+TEST(simd_float_to_s16, clamps) {
+  const float samples[] = {-2.f, -1.f, 0.f, 0.5f, 1.f, 2.f};
+  int16_t out[6];
+
+  simd_float_to_s16(samples, out, 6);
+
+  EXPECT_EQ(out[0], -32768);
+  EXPECT_EQ(out[1], -32767);
+  EXPECT_EQ(out[2], 0);
+  EXPECT_EQ(out[3], 16383);
+  EXPECT_EQ(out[4], 32767);
+  EXPECT_EQ(out[5], 32767);
+}
+
+// Voices in every state the renderers handle: looping or not, filtered or not,
+// reaching their end or their loop end within a block, stopped already,
+// reading from a window of the samples like the lazily loaded ones.
+struct TestVoices {
+  std::vector<float> samples;
+  std::vector<const float *> input;
+  std::vector<unsigned> base, loop_start, loop_end;
+  std::vector<double> position, pitch_ratio, end;
+  std::vector<tsf_lowpass_real> a0, a1, b1, b2, z1, z2;
+  std::vector<float> gain_left, gain_right;
+
+  explicit TestVoices(int count) : samples(4096) {
+    for (size_t i = 0; i < samples.size(); ++i)
+      samples[i] = sinf(i * 0.37f) * (i % 5 + 1) / 5;
+
+    for (int v = 0; v < count; ++v) {
+      unsigned start = 100 * v;
+      bool window = v % 2, looping = v % 3;
+      input.push_back(samples.data() + (window ? start : 0));
+      base.push_back(window ? start : 0);
+      loop_start.push_back(looping ? start + 10 : 0);
+      loop_end.push_back(looping ? start + 40 + v : 0);
+      end.push_back(start + (looping ? 200 : 30 + 5 * v));
+      position.push_back(v == 5 ? end.back() + 1 : start + 10 + v * 0.3);
+      pitch_ratio.push_back(0.25 + 0.37 * v);
+
+      // a low-pass at a tenth of the sample rate, else passing through
+      bool filtered = v % 4 == 1;
+      a0.push_back(filtered ? 0.0675 : 1);
+      a1.push_back(filtered ? 0.135 : 0);
+      b1.push_back(filtered ? -1.143 : 0);
+      b2.push_back(filtered ? 0.4128 : 0);
+      z1.push_back(filtered ? 0.1 : 0);
+      z2.push_back(filtered ? -0.05 : 0);
+      gain_left.push_back(1.0f / (v + 1));
+      gain_right.push_back(0.5f);
+    }
+  }
+
+  tsf_voice_lanes lanes() {
+    return {(int)input.size(), input.data(),       base.data(),
+            loop_start.data(), loop_end.data(),    position.data(),
+            pitch_ratio.data(), end.data(),        a0.data(),
+            a1.data(),         b1.data(),          b2.data(),
+            z1.data(),         z2.data(),          gain_left.data(),
+            gain_right.data()};
+  }
+};
+
+TEST(simd_render_voices, matches_scalar) {
+  for (int count : {1, 4, 6, 13}) {
+    for (int level = SIMD_SCALAR; level <= simd_detect(); ++level) {
+      TestVoices expected(count), result(count);
+      auto expected_lanes = expected.lanes(), result_lanes = result.lanes();
+
+      // odd sizes and more than a tsf block
+      for (int frames : {64, 150, 7}) {
+        std::vector<float> want(2 * frames, 0.25f), got(2 * frames, 0.25f);
+        simd_render_voices(SIMD_SCALAR, expected_lanes, want.data(), frames);
+        simd_render_voices((SimdLevel)level, result_lanes, got.data(),
+                           frames);
+
+        // the same voices, summed in another order
+        EXPECT_EQ(expected.position, result.position) << "level " << level;
+        EXPECT_EQ(expected.z1, result.z1) << "level " << level;
+        EXPECT_EQ(expected.z2, result.z2) << "level " << level;
+        for (int i = 0; i < 2 * frames; ++i)
+          ASSERT_NEAR(want[i], got[i], 1e-5)
+              << "level " << level << " count " << count << " sample " << i;
+      }
+    }
+  }
+}
+
+// The filters against double precision ones, with cutoffs and resonances over
+// the range SoundFont regions have. The voice plays a loud noise-like sample
+// at its pitch, so the filter is all that differs.
+TEST(simd_render_voices, lowpass_accuracy) {
+  std::vector<float> samples(4096);
+  uint32_t x = 1;
+  for (auto &s : samples) {
+    x = x * 1664525 + 1013904223;
+    s = (int16_t)(x >> 16) / 32768.0f;
+  }
+
+  for (int level = SIMD_SCALAR; level <= simd_detect(); ++level) {
+    for (double hz : {20, 50, 200, 1000, 5000, 15000, 21000}) {
+      for (double q : {0, 6, 24, 48}) {
+        // tsf_voice_lowpass_setup()
+        double qinv = 1.0 / pow(10.0, q / 20.0);
+        double k = tan(3.14159265358979323846 * hz / 44100), kk = k * k;
+        double norm = 1 / (1 + k * qinv + kk);
+        double a0 = kk * norm, a1 = 2 * a0, b1 = 2 * (kk - 1) * norm,
+               b2 = (1 - k * qinv + kk) * norm;
+
+        const float *input = samples.data();
+        unsigned base = 0, loop_start = 0, loop_end = 4095;
+        double position = 0, pitch_ratio = 1, end = 1e9;
+        tsf_lowpass_real fa0 = (tsf_lowpass_real)a0, fa1 = 2 * fa0,
+                         fb1 = (tsf_lowpass_real)b1,
+                         fb2 = (tsf_lowpass_real)b2, z1 = 0, z2 = 0;
+        float gain_left = 1, gain_right = 0;
+        tsf_voice_lanes lanes = {
+            1,         &input, &base, &loop_start, &loop_end, &position,
+            &pitch_ratio, &end, &fa0, &fa1, &fb1, &fb2, &z1, &z2,
+            &gain_left, &gain_right};
+
+        double ref_z1 = 0, ref_z2 = 0, worst = 0;
+        std::vector<float> out(2 * 64);
+        for (int block = 0; block < 44100 / 64; ++block) {
+          std::fill(out.begin(), out.end(), 0.0f);
+          simd_render_voices((SimdLevel)level, lanes, out.data(), 64);
+
+          for (int t = 0; t < 64; ++t) {
+            double in = samples[(block * 64 + t) % 4096];
+            double ref = in * a0 + ref_z1;
+            ref_z1 = in * a1 + ref_z2 - b1 * ref;
+            ref_z2 = in * a0 - b2 * ref;
+            worst = std::max(worst, fabs(out[2 * t] - ref));
+          }
+        }
+#ifdef TSF_LOWPASS_FLOAT
+        // measured at most 4.2e-4 with resonances up to 6 dB, 1.4e-3 up to
+        // 24 dB, and 1.1e-2 at 50 Hz and 48 dB, where rounding the
+        // coefficients moves the poles most
+        double bound = q <= 6 ? 1e-3 : q <= 24 ? 3e-3 : 2e-2;
+#else
+        double bound = 2e-6; // the output rounded to float
+#endif
+        EXPECT_LT(worst, bound)
+            << "level " << level << " " << hz << " Hz, Q " << q << " dB";
+      }
+    }
+  }
+}
@@ -0,0 +1,427 @@
+#include "../core/machine.hpp"
+#include "../core/pool.hpp"
+#include "../core/simd.hpp"
+#include "../core/soundfont.hpp"
+#include "../core/tsf.h"
+#include <algorithm>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static Machine loaded(const char *patch) {
+  Machine m;
+  m.load_string(patch);
+  return m;
+}
+
+TEST(soundfont, loaded_once) {
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+
+  {
+    auto a = loaded("...\n");
+    auto b = loaded("...\n");
+    EXPECT_EQ(soundfonts_loaded(), 1u);
+    EXPECT_NE((tsf *)a.sf, (tsf *)b.sf);
+
+    // the voices are each machine's own
+    tsf_channel_note_on(a.sf, 0, 60, 1.0f);
+    EXPECT_EQ(tsf_active_voice_count(a.sf), 1);
+    EXPECT_EQ(tsf_active_voice_count(b.sf), 0);
+  }
+
+  // freed with the last machine, loaded again by the next one
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+  auto c = loaded("...\n");
+  EXPECT_EQ(soundfonts_loaded(), 1u);
+}
+
+TEST(soundfont, missing_file) {
+  EXPECT_EQ(open_soundfont("/nonexistent.sf2"), nullptr);
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+}
+
+TEST(soundfont, machines_on_threads) {
+  ThreadPool pool(4);
+  std::vector<std::unique_ptr<Machine>> machines(64);
+
+  for (int round = 0; round < 20; ++round) {
+    pool.run(machines.size(), [&](size_t i) {
+      if (machines[i]) {
+        machines[i].reset();
+      } else {
+        machines[i].reset(new Machine());
+        machines[i]->load_string(".:03C\n");
+      }
+    });
+  }
+
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+}
+
+// An .sf2 file with a looping preset per sample, preset i playing sample i
+// through instrument i.
+struct TestSoundFont {
+  std::string data;
+
+  void put(uint32_t v, int size) {
+    for (int i = 0; i < size; ++i)
+      data += (char)(i < 4 ? v >> 8 * i : 0);
+  }
+
+  void put_name(const char *name) {
+    data += std::string(name).append(20, 0).substr(0, 20);
+  }
+
+  size_t begin(const char *id) {
+    data += id;
+    put(0, 4);
+    return data.size();
+  }
+
+  void end(size_t start) {
+    auto size = data.size() - start;
+    for (int i = 0; i < 4; ++i)
+      data[start - 4 + i] = (char)(size >> 8 * i);
+  }
+
+  TestSoundFont(int samples, unsigned length) {
+    unsigned stride = length + 46; // and the zeroes after each sample
+
+    auto riff = begin("RIFF");
+    data += "sfbk";
+
+    auto sdta = begin("LIST");
+    data += "sdta";
+    auto smpl = begin("smpl");
+    for (int s = 0; s < samples; ++s) {
+      for (unsigned i = 0; i < length; ++i)
+        put((uint16_t)((i * 7919 + s * 4099) % 60000 - 30000), 2);
+      put(0, 2 * 46);
+    }
+    end(smpl);
+    end(sdta);
+
+    auto pdta = begin("LIST");
+    data += "pdta";
+
+    // the last of each is the terminal record
+    auto chunk = begin("phdr");
+    for (int s = 0; s <= samples; ++s) {
+      put_name("preset");
+      put(s, 2); // preset
+      put(0, 2); // bank
+      put(s, 2); // bag
+      put(0, 12);
+    }
+    end(chunk);
+
+    chunk = begin("pbag");
+    for (int s = 0; s <= samples; ++s) {
+      put(s, 2);
+      put(0, 2);
+    }
+    end(chunk);
+
+    chunk = begin("pmod");
+    put(0, 10);
+    end(chunk);
+
+    chunk = begin("pgen");
+    for (int s = 0; s <= samples; ++s) {
+      put(41, 2); // instrument
+      put(s, 2);
+    }
+    end(chunk);
+
+    chunk = begin("inst");
+    for (int s = 0; s <= samples; ++s) {
+      put_name("instrument");
+      put(s, 2);
+    }
+    end(chunk);
+
+    chunk = begin("ibag");
+    for (int s = 0; s <= samples; ++s) {
+      put(2 * s, 2);
+      put(0, 2);
+    }
+    end(chunk);
+
+    chunk = begin("imod");
+    put(0, 10);
+    end(chunk);
+
+    chunk = begin("igen");
+    for (int s = 0; s <= samples; ++s) {
+      put(54, 2); // sampleModes, looping
+      put(1, 2);
+      put(53, 2); // sampleID
+      put(s, 2);
+    }
+    end(chunk);
+
+    chunk = begin("shdr");
+    for (int s = 0; s <= samples; ++s) {
+      put_name("sample");
+      put(s * stride, 4);
+      put(s * stride + length, 4);
+      put(s * stride + 8, 4);
+      put(s * stride + length - 8, 4);
+      put(44100, 4);
+      put(60, 1);
+      put(0, 1);
+      put(0, 2);
+      put(1, 2); // mono
+    }
+    end(chunk);
+
+    end(pdta);
+    end(riff);
+  }
+
+  std::string save(const char *name) {
+    auto path = testing::TempDir() + name;
+    std::ofstream(path, std::ios::binary) << data;
+    return path;
+  }
+};
+
+static std::vector<float> render(tsf *font, int samples) {
+  std::vector<float> out(2 * samples);
+  tsf_render_float(font, out.data(), samples);
+  return out;
+}
+
+TEST(soundfont, file_samples_converted_when_played) {
+  auto path = TestSoundFont(8, 20000).save("lazy.sf2");
+  auto eager = tsf_load_filename(path.c_str());
+  ASSERT_NE(eager, nullptr);
+
+  {
+    SoundFontCopy lazy;
+    lazy = open_soundfont(path);
+    ASSERT_NE((tsf *)lazy, nullptr);
+    EXPECT_EQ(samples_resident(path), 0u);
+
+    for (auto font : {eager, (tsf *)lazy}) {
+      tsf_set_output(font, TSF_STEREO_INTERLEAVED, 44100, 0);
+      tsf_note_on(font, 3, 60, 1.0f);
+      tsf_note_on(font, 5, 72, 0.5f);
+    }
+
+    // the two regions, up to the sample interpolated with their last one
+    EXPECT_EQ(samples_resident(path), 2 * 20002 * sizeof(float));
+
+    for (int block = 0; block < 20; ++block) {
+      ASSERT_EQ(render(lazy, 4096), render(eager, 4096)) << "block " << block;
+
+      if (block == 10)
+        for (auto font : {eager, (tsf *)lazy})
+          tsf_note_off(font, 3, 60);
+    }
+  }
+
+  EXPECT_EQ(samples_resident(path), 0u);
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+  tsf_close(eager);
+}
+
+TEST(soundfont, file_samples_cache_limit) {
+  auto path = TestSoundFont(4, 1000).save("cache.sf2");
+  size_t region = 1002 * sizeof(float);
+
+  SoundFontCopy font;
+  font = open_soundfont(path);
+  ASSERT_NE((tsf *)font, nullptr);
+
+  // released with the copy playing them, kept while under the limit
+  set_sample_cache_limit(2 * region);
+  for (int preset = 0; preset < 2; ++preset) {
+    SoundFontCopy copy;
+    copy = open_soundfont(path);
+    tsf_note_on(copy, preset, 60, 1.0f);
+  }
+  EXPECT_EQ(samples_resident(path), 2 * region);
+
+  // past it, only the playing ones stay
+  {
+    SoundFontCopy copy;
+    copy = open_soundfont(path);
+    tsf_note_on(copy, 2, 60, 1.0f);
+    tsf_note_on(copy, 3, 60, 1.0f);
+    EXPECT_EQ(samples_resident(path), 2 * region);
+
+    set_sample_cache_limit(0);
+    tsf_note_on(copy, 0, 60, 1.0f);
+    EXPECT_EQ(samples_resident(path), 3 * region);
+  }
+  EXPECT_EQ(samples_resident(path), 0u);
+
+  set_sample_cache_limit(64 << 20);
+}
+
+TEST(soundfont, file_samples_on_threads) {
+  auto path = TestSoundFont(16, 5000).save("threads.sf2");
+  ThreadPool pool(4);
+  std::vector<SoundFontCopy> fonts(32);
+
+  pool.run(fonts.size(), [&](size_t i) {
+    fonts[i] = open_soundfont(path);
+    tsf_set_output(fonts[i], TSF_STEREO_INTERLEAVED, 44100, 0);
+    for (int note = 0; note < 200; ++note) {
+      tsf_note_on(fonts[i], (i + note) % 16, 60, 1.0f);
+      render(fonts[i], 256);
+      tsf_note_off(fonts[i], (i + note) % 16, 60);
+    }
+  });
+
+  EXPECT_LE(samples_resident(path), 16 * 5002 * sizeof(float));
+  fonts.clear();
+  EXPECT_EQ(soundfonts_loaded(), 0u);
+}
+
+TEST(soundfont, switch_at_the_next_tick) {
+  Machine m;
+  m.load_string("...\n");
+  m.run(); // the first tick
+
+  tsf *next = open_soundfont();
+  Machine::prepare_soundfont(next);
+  m.play_note({2, 60, 1.0f, 30}, false);
+  tsf_channel_set_pan(m.sf, 2, 1.0f);
+  m.switch_soundfont(next);
+
+  // bpm 120 ticks every 8 frames
+  for (int frame = 1; frame < 8; ++frame) {
+    m.run();
+    EXPECT_NE((tsf *)m.sf, next);
+  }
+
+  auto previous = (tsf *)m.sf;
+  m.run();
+  EXPECT_EQ((tsf *)m.sf, next);
+  EXPECT_EQ((tsf *)m.fading_sf, previous);
+
+  // the note goes on with the new one, the old one fades out
+  EXPECT_EQ(tsf_active_voice_count(m.sf), 1);
+  EXPECT_EQ(tsf_channel_get_pan(m.sf, 2), 1.0f);
+
+  int frames = 1;
+  while (m.fading_sf) {
+    m.run();
+    frames++;
+  }
+  EXPECT_EQ(frames * m.audio_samples.size() / 2,
+            (size_t)Machine::SOUNDFONT_FADE);
+
+  // left for the owner to close
+  ASSERT_EQ(m.retired_sf.size(), 1u);
+  EXPECT_EQ((tsf *)m.retired_sf[0], previous);
+  m.retired_sf.clear();
+  EXPECT_EQ(soundfonts_loaded(), 1u);
+}
+
+TEST(soundfont, switches_during_a_fade_queue_up) {
+  Machine m;
+  m.load_string("...\n");
+  m.run();
+
+  std::vector<tsf *> played = {m.sf};
+  for (int n = 0; n < 2; ++n) {
+    tsf *next = open_soundfont();
+    Machine::prepare_soundfont(next);
+    m.switch_soundfont(next);
+    m.use_next_soundfont();
+    played.push_back(next);
+  }
+
+  // the second switch cut the first fade short, nothing was closed
+  ASSERT_EQ(m.retired_sf.size(), 1u);
+  EXPECT_EQ((tsf *)m.retired_sf[0], played[0]);
+  EXPECT_EQ((tsf *)m.fading_sf, played[1]);
+  EXPECT_EQ((tsf *)m.sf, played[2]);
+
+  while (m.fading_sf)
+    m.run();
+  ASSERT_EQ(m.retired_sf.size(), 2u);
+  EXPECT_EQ((tsf *)m.retired_sf[1], played[1]);
+}
+
+TEST(soundfont, find_soundfonts) {
+  auto b = TestSoundFont(1, 100).save("b_found.sf2");
+  auto a = TestSoundFont(1, 100).save("a_found.sf2");
+  auto dir = a.substr(0, a.find_last_of('/'));
+
+  auto found = find_soundfonts({"/nonexistent", dir});
+  auto at_a = std::find(found.begin(), found.end(), a);
+  auto at_b = std::find(found.begin(), found.end(), b);
+  EXPECT_NE(at_a, found.end());
+  EXPECT_EQ(at_a + 1, at_b);
+}
+
+TEST(soundfont, float_output_converts_like_tsf) {
+  SoundFontCopy as_short, as_float;
+  as_short = open_soundfont();
+  as_float = open_soundfont();
+
+  std::vector<int16_t> expected(2 * 4096), result(2 * 4096);
+  for (auto font : {(tsf *)as_short, (tsf *)as_float}) {
+    Machine::prepare_soundfont(font);
+    for (int key = 40; key < 90; key += 7)
+      tsf_channel_note_on(font, 0, key, 1.0f);
+  }
+
+  for (int block = 0; block < 10; ++block) {
+    tsf_render_short(as_short, expected.data(), 4096);
+    auto samples = render(as_float, 4096);
+    simd_float_to_s16(samples.data(), result.data(), samples.size());
+    ASSERT_EQ(expected, result) << "block " << block;
+  }
+}
+
+TEST(soundfont, voice_lanes_match_one_by_one) {
+  SoundFontCopy one_by_one, scalar, lanes;
+  one_by_one = open_soundfont();
+  scalar = open_soundfont();
+  lanes = open_soundfont();
+  tsf_set_lanes_renderer(one_by_one, nullptr);
+  tsf_set_lanes_renderer(scalar, [](tsf_voice_lanes *l, float *out, int n) {
+    simd_render_voices(SIMD_SCALAR, *l, out, n);
+  });
+
+  // as many voices as dense : patches get, panned and bent apart
+  auto fonts = {(tsf *)one_by_one, (tsf *)scalar, (tsf *)lanes};
+  for (auto font : fonts) {
+    Machine::prepare_soundfont(font);
+    for (int i = 0; i < 64; ++i) {
+      tsf_channel_set_pan(font, i % 7, (i % 7) / 6.0f);
+      tsf_channel_set_pitchwheel(font, i % 7, 8192 + 300 * (i % 7));
+      tsf_channel_note_on(font, i % 7, 30 + i, 0.2f + (i % 5) * 0.2f);
+    }
+  }
+  ASSERT_EQ(tsf_active_voice_count(lanes), 64);
+
+  for (int block = 0; block < 20; ++block) {
+    // not a multiple of the blocks of tsf
+    auto expected = render(one_by_one, 1000);
+    ASSERT_EQ(expected, render(scalar, 1000)) << "block " << block;
+
+    // the voices summed in another order
+    auto result = render(lanes, 1000);
+    for (size_t i = 0; i < expected.size(); ++i)
+      ASSERT_NEAR(expected[i], result[i], 1e-5)
+          << "block " << block << " sample " << i;
+    ASSERT_EQ(tsf_active_voice_count(lanes),
+              tsf_active_voice_count(one_by_one));
+
+    if (block == 5)
+      for (auto font : fonts)
+        tsf_channel_note_off_all(font, 3);
+  }
+
+  // the released ones ended the same
+  EXPECT_LT(tsf_active_voice_count(lanes), 64);
+}